@@ -19,6 +19,10 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
 #include "kiss_fft.h"
 #include <limits.h>
 
+/* The twiddles are part of the config, which is already in RAM, so
+   HOT_IN_RAM only needs to move the transforms themselves. */
+#include "hot_in_ram.h"
+
 #define MAXFACTORS 32
 /* e.g. an fft of length 128 has 4 factors 
  as far as kissfft is concerned
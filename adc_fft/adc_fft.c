@@ -6,62 +6,161 @@
 
 #include <stdio.h>
 #include <math.h>
+#include <string.h>
+#include <stdlib.h>
 
 #include "pico/stdlib.h"
 #include "hardware/adc.h"
 #include "hardware/dma.h"
 #include "kiss_fftr.h"
 
-// set this to determine sample rate
-// 0     = 500,000 Hz
-// 960   = 50,000 Hz
-// 9600  = 5,000 Hz
-#define CLOCK_DIV 960
+// Starting sample rate and block size. Both can be changed while
+// running by sending commands over serial:
+//   rate <Hz>     sample rate, 733 to 500000 Hz
+//   nsamp <n>     samples per FFT, even
+//   config        print the current settings
+// and, when built with SPECTRUM_TELEMETRY,
+//   bands <n>     bands to sum the bins into, 0 for every bin
+//   bits <8|16>   size of each value sent
+// The ADC clock divider is worked out from the rate, so the actual rate
+// is the nearest one the ADC can do.
 #define FSAMP 50000
+#define NSAMP 1000
 
 // Channel 0 is GPIO26
 #define CAPTURE_CHANNEL 0
 #define LED_PIN 25
 
-// BE CAREFUL: anything over about 9000 here will cause things
-// to silently break. The code will compile and upload, but due
-// to memory issues nothing will work properly
-#define NSAMP 1000
+// The sample, FFT and frequency buffers and the FFT plan are all carved
+// out of this arena, so the block size is limited by it rather than by
+// the stack. A block needs about 20 bytes per sample.
+#define ARENA_BYTES (96 * 1024)
+
+// The ADC runs from the 48 MHz USB clock and takes 96 cycles per
+// conversion; the clock divider's integer part is 16 bits
+#define ADC_CLOCK 48000000
+#define FSAMP_MAX (ADC_CLOCK / 96)
+#define FSAMP_MIN (ADC_CLOCK / 65536 + 1)
+
+struct config {
+  uint32_t fsamp;  // requested sample rate
+  uint nsamp;      // samples per FFT
+  float clkdiv;    // adc_set_clkdiv() value for fsamp
+  float fsamp_real; // rate that clkdiv actually gives
+  uint dc_shift;   // DC blocker pole is 1 - 2^-dc_shift
+};
+
+// One-pole DC blocker, y[n] = x[n] - x[n-1] + (1 - 2^-shift) y[n-1], in
+// fixed point with DC_FRAC_BITS fractional bits. It keeps its state from
+// one block to the next, so the level it removes doesn't jump between
+// blocks the way a per-block mean does.
+#define DC_FRAC_BITS 16
+
+struct dc_blocker {
+  int32_t x1;  // previous input
+  int32_t acc; // previous output, DC_FRAC_BITS fractional bits
+  bool primed;
+};
+
+static inline int32_t dc_block(struct dc_blocker *b, int32_t x, uint shift) {
+  b->acc += (x - b->x1) * (1 << DC_FRAC_BITS) - (b->acc >> shift);
+  b->x1 = x;
+  return b->acc;
+}
+
+#if SPECTRUM_TELEMETRY
+// Instead of the strongest frequency as text, every block's spectrum is
+// sent as a binary frame, little endian:
+//   a5 5a                  sync
+//   u8 flags               bit 0 set for 16-bit values
+//   u8 q                   fractional bits in each value
+//   u16 seq                frame count, to spot dropped frames
+//   u16 count              values that follow
+//   u16 nsamp              block size
+//   u32 fsamp              sample rate in mHz
+//   count x u8/u16         log2 of the power of each bin or band
+//   u16 check              Fletcher-16 of everything after the sync
+// The first nsamp/2 bins are sent, or summed into equal bands. A value is
+// log2 of |X|^2 for the unscaled FFT of ADC codes, with q fractional bits
+// (3.01 dB per unit), 0 for a power below 1. adc_fft/py/spectrum.py reads
+// the frames. Text (command replies) can appear between frames.
+#define TELEMETRY_SYNC0 0xa5
+#define TELEMETRY_SYNC1 0x5a
+#define TELEMETRY_Q8 2    // 0.75 dB steps, up to 2^64
+#define TELEMETRY_Q16 10
+#ifndef TELEMETRY_BANDS
+#define TELEMETRY_BANDS 0
+#endif
+#ifndef TELEMETRY_BITS
+#define TELEMETRY_BITS 8
+#endif
+
+struct telemetry {
+  uint bands;   // 0 for every bin
+  uint bits;    // 8 or 16
+  uint16_t seq;
+  uint16_t c0, c1; // running Fletcher-16 sums
+};
+#endif
 
 // globals
 dma_channel_config cfg;
 uint dma_chan;
-float freqs[NSAMP];
+struct config conf;
+struct dc_blocker dc;
+#if SPECTRUM_TELEMETRY
+struct telemetry tele = { TELEMETRY_BANDS, TELEMETRY_BITS, 0, 0, 0 };
+#endif
+
+uint8_t arena[ARENA_BYTES] __attribute__((aligned(8)));
+uint8_t *cap_buf;
+kiss_fft_scalar *fft_in; // kiss_fft_scalar is a float
+kiss_fft_cpx *fft_out;
+float *freqs;
+kiss_fftr_cfg fft_cfg;
 
 void setup();
 void sample(uint8_t *capture_buf);
+bool configure(uint32_t fsamp, uint nsamp);
+void poll_commands();
+#if SPECTRUM_TELEMETRY
+void send_spectrum();
+#endif
 
 int main() {
-  uint8_t cap_buf[NSAMP];
-  kiss_fft_scalar fft_in[NSAMP]; // kiss_fft_scalar is a float
-  kiss_fft_cpx fft_out[NSAMP];
-  kiss_fftr_cfg cfg = kiss_fftr_alloc(NSAMP,false,0,0);
-  
   // setup ports and outputs
   setup();
 
+  if (!configure(FSAMP, NSAMP)) {
+    while (1) {
+      printf("Default FSAMP/NSAMP do not fit!\n");
+      sleep_ms(2000);
+    }
+  }
+
   while (1) {
+    poll_commands();
+
     // get NSAMP samples at FSAMP
     sample(cap_buf);
-    // fill fourier transform input while subtracting DC component
-    uint64_t sum = 0;
-    for (int i=0;i<NSAMP;i++) {sum+=cap_buf[i];}
-    float avg = (float)sum/NSAMP;
-    for (int i=0;i<NSAMP;i++) {fft_in[i]=(float)cap_buf[i]-avg;}
+    // fill fourier transform input while blocking DC component
+    if (!dc.primed) {dc.x1 = cap_buf[0]; dc.acc = 0; dc.primed = true;}
+    const float dc_scale = 1.0f / (1 << DC_FRAC_BITS);
+    for (uint i=0;i<conf.nsamp;i++) {
+      fft_in[i] = dc_block(&dc, cap_buf[i], conf.dc_shift) * dc_scale;
+    }
 
     // compute fast fourier transform
-    kiss_fftr(cfg , fft_in, fft_out);
+    kiss_fftr(fft_cfg , fft_in, fft_out);
     
+#if SPECTRUM_TELEMETRY
+    send_spectrum();
+#else
     // compute power and calculate max freq component
     float max_power = 0;
-    int max_idx = 0;
+    uint max_idx = 0;
     // any frequency bin over NSAMP/2 is aliased (nyquist sampling theorum)
-    for (int i = 0; i < NSAMP/2; i++) {
+    for (uint i = 0; i < conf.nsamp/2; i++) {
       float power = fft_out[i].r*fft_out[i].r+fft_out[i].i*fft_out[i].i;
       if (power>max_power) {
 	max_power=power;
@@ -71,10 +170,179 @@ int main() {
 
     float max_freq = freqs[max_idx];
     printf("Greatest Frequency Component: %0.1f Hz\n",max_freq);
+#endif
+  }
+}
+
+#if SPECTRUM_TELEMETRY
+// log2(x) with q fractional bits, from the float's exponent and the top
+// 16 bits of its mantissa m, with log2(1+m) ~ m + 0.3466 m (1 - m). No
+// soft-float calls, and good to about 0.01.
+static uint32_t log2_q(float x, uint q) {
+  if (!(x > 1)) return 0;
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  uint32_t e = (bits >> 23) - 127;
+  uint32_t m = (bits >> 7) & 0xffff;
+  uint32_t corr = (uint32_t)(((uint64_t)m * (65536 - m)) >> 16) * 22713 >> 16;
+  return (e << q) + ((m + corr) >> (16 - q));
+}
+
+// Sends a byte raw (no CR/LF translation), adding it to the checksum
+static void tele_put(uint8_t b) {
+  tele.c0 = (tele.c0 + b) % 255;
+  tele.c1 = (tele.c1 + tele.c0) % 255;
+  putchar_raw(b);
+}
+
+static void tele_put16(uint16_t v) { tele_put(v & 0xff); tele_put(v >> 8); }
+
+// Sends the spectrum in fft_out as a frame
+void send_spectrum() {
+  uint bins = conf.nsamp / 2;
+  uint count = tele.bands && tele.bands < bins ? tele.bands : bins;
+  bool wide = tele.bits == 16;
+  uint q = wide ? TELEMETRY_Q16 : TELEMETRY_Q8;
+  uint32_t top = wide ? 0xffff : 0xff;
+  uint32_t mhz = (uint32_t)(conf.fsamp_real * 1000 + 0.5f);
+
+  putchar_raw(TELEMETRY_SYNC0);
+  putchar_raw(TELEMETRY_SYNC1);
+  tele.c0 = tele.c1 = 0;
+  tele_put(wide ? 1 : 0);
+  tele_put(q);
+  tele_put16(tele.seq++);
+  tele_put16(count);
+  tele_put16(conf.nsamp);
+  tele_put16(mhz & 0xffff);
+  tele_put16(mhz >> 16);
+
+  // band b sums bins [b*bins/count, (b+1)*bins/count)
+  uint k = 0;
+  for (uint b = 0; b < count; b++) {
+    uint end = (b + 1) * bins / count;
+    float power = 0;
+    for (; k < end; k++)
+      power += fft_out[k].r*fft_out[k].r + fft_out[k].i*fft_out[k].i;
+    uint32_t v = log2_q(power, q);
+    if (v > top) v = top;
+    if (wide) tele_put16(v);
+    else tele_put(v);
   }
 
-  // should never get here
-  kiss_fft_free(cfg);
+  uint16_t check = tele.c1 << 8 | tele.c0;
+  putchar_raw(check & 0xff);
+  putchar_raw(check >> 8);
+}
+#endif
+
+// Bytes of arena a block of nsamp samples needs, each piece rounded up
+// to 8 bytes as it is handed out
+static size_t arena_round(size_t n) { return (n + 7) & ~(size_t)7; }
+
+static size_t arena_needed(uint nsamp) {
+  size_t plan = 0;
+  kiss_fftr_alloc(nsamp, false, NULL, &plan);
+  return arena_round(nsamp) +
+    arena_round(sizeof(kiss_fft_scalar) * nsamp) +
+    arena_round(sizeof(kiss_fft_cpx) * (nsamp/2+1)) +
+    arena_round(sizeof(float) * (nsamp/2)) +
+    arena_round(plan);
+}
+
+// Sets the sample rate and block size, rebuilding the buffers, the
+// frequency table and the FFT plan. Nothing changes if they are out of
+// range or do not fit in the arena.
+bool configure(uint32_t fsamp, uint nsamp) {
+  if (fsamp < FSAMP_MIN || fsamp > FSAMP_MAX) {
+    printf("Rate must be %d to %d Hz\n", FSAMP_MIN, FSAMP_MAX);
+    return false;
+  }
+  if (nsamp < 16 || (nsamp & 1)) {
+    printf("NSAMP must be even and at least 16\n");
+    return false;
+  }
+  size_t needed = arena_needed(nsamp);
+  if (needed > ARENA_BYTES) {
+    printf("NSAMP %u needs %u bytes, only %u available\n",
+	   nsamp, (unsigned)needed, ARENA_BYTES);
+    return false;
+  }
+
+  // a conversion starts every 1 + clkdiv cycles, with 8 fractional bits
+  conf.fsamp = fsamp;
+  conf.nsamp = nsamp;
+  conf.clkdiv = roundf(((float)ADC_CLOCK / fsamp - 1) * 256) / 256;
+  conf.fsamp_real = ADC_CLOCK / (1 + conf.clkdiv);
+  adc_set_clkdiv(conf.clkdiv);
+
+  // DC blocker corner one to three FFT bins up, with a time constant
+  // of at most an eighth of a block so it settles quickly after this
+  conf.dc_shift = 4;
+  while (conf.dc_shift < 15 && (8u << (conf.dc_shift + 1)) <= nsamp)
+    conf.dc_shift++;
+  dc.primed = false;
+
+  uint8_t *p = arena;
+  cap_buf = p; p += arena_round(nsamp);
+  fft_in = (kiss_fft_scalar *)p; p += arena_round(sizeof(kiss_fft_scalar) * nsamp);
+  fft_out = (kiss_fft_cpx *)p; p += arena_round(sizeof(kiss_fft_cpx) * (nsamp/2+1));
+  freqs = (float *)p; p += arena_round(sizeof(float) * (nsamp/2));
+  size_t plan = ARENA_BYTES - (p - arena);
+  fft_cfg = kiss_fftr_alloc(nsamp, false, p, &plan);
+
+  // calculate frequencies of each bin
+  float f_res = conf.fsamp_real / nsamp;
+  for (uint i = 0; i < nsamp/2; i++) {freqs[i] = f_res*i;}
+
+  printf("Config: %0.1f Hz (clkdiv %0.2f), NSAMP %u, %u of %u bytes\n",
+	 conf.fsamp_real, conf.clkdiv, conf.nsamp, (unsigned)needed,
+	 ARENA_BYTES);
+  return true;
+}
+
+// Reads whatever has arrived over serial without waiting and acts on
+// each complete line
+void poll_commands() {
+  static char line[32];
+  static uint len = 0;
+  int c;
+
+  while ((c = getchar_timeout_us(0)) != PICO_ERROR_TIMEOUT) {
+    if (c != '\n' && c != '\r') {
+      if (len < sizeof(line) - 1) line[len++] = c;
+      continue;
+    }
+    line[len] = 0;
+    len = 0;
+
+    char *arg = strchr(line, ' ');
+    if (arg) *arg++ = 0;
+
+    if (!strcmp(line, "rate") && arg) {
+      configure(strtoul(arg, NULL, 10), conf.nsamp);
+    } else if (!strcmp(line, "nsamp") && arg) {
+      configure(conf.fsamp, strtoul(arg, NULL, 10));
+    } else if (!strcmp(line, "config")) {
+      printf("Config: %0.1f Hz (clkdiv %0.2f), NSAMP %u, %u of %u bytes\n",
+	     conf.fsamp_real, conf.clkdiv, conf.nsamp,
+	     (unsigned)arena_needed(conf.nsamp), ARENA_BYTES);
+#if SPECTRUM_TELEMETRY
+    } else if (!strcmp(line, "bands") && arg) {
+      tele.bands = strtoul(arg, NULL, 10);
+    } else if (!strcmp(line, "bits") && arg) {
+      uint bits = strtoul(arg, NULL, 10);
+      if (bits == 8 || bits == 16) tele.bits = bits;
+      else printf("Bits must be 8 or 16\n");
+    } else if (line[0]) {
+      printf("Commands: rate <Hz>, nsamp <n>, config, bands <n>, bits <8|16>\n");
+    }
+#else
+    } else if (line[0]) {
+      printf("Commands: rate <Hz>, nsamp <n>, config\n");
+    }
+#endif
+  }
 }
 
 void sample(uint8_t *capture_buf) {
@@ -84,7 +352,7 @@ void sample(uint8_t *capture_buf) {
   dma_channel_configure(dma_chan, &cfg,
 			capture_buf,    // dst
 			&adc_hw->fifo,  // src
-			NSAMP,          // transfer count
+			conf.nsamp,     // transfer count
 			true            // start immediately
 			);
 
@@ -112,9 +380,6 @@ void setup() {
 		 true     // Shift each sample to 8 bits when pushing to FIFO
 		 );
 
-  // set sample rate
-  adc_set_clkdiv(CLOCK_DIV);
-
   sleep_ms(1000);
   // Set up the DMA to start transferring data as soon as it appears in FIFO
   uint dma_chan = dma_claim_unused_channel(true);
@@ -127,9 +392,4 @@ void setup() {
 
   // Pace transfers based on availability of ADC samples
   channel_config_set_dreq(&cfg, DREQ_ADC);
-
-  // calculate frequencies of each bin
-  float f_max = FSAMP;
-  float f_res = f_max / NSAMP;
-  for (int i = 0; i < NSAMP; i++) {freqs[i] = f_res*i;}
 }
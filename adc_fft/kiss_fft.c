@@ -18,7 +18,7 @@ THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
  fixed or floating point complex numbers.  It also delares the kf_ internal functions.
  */
 
-static void kf_bfly2(
+static void HOT_FUNC(kf_bfly2)(
         kiss_fft_cpx * Fout,
         const size_t fstride,
         const kiss_fft_cfg st,
@@ -41,7 +41,7 @@ static void kf_bfly2(
     }while (--m);
 }
 
-static void kf_bfly4(
+static void HOT_FUNC(kf_bfly4)(
         kiss_fft_cpx * Fout,
         const size_t fstride,
         const kiss_fft_cfg st,
@@ -89,7 +89,7 @@ static void kf_bfly4(
     }while(--k);
 }
 
-static void kf_bfly3(
+static void HOT_FUNC(kf_bfly3)(
          kiss_fft_cpx * Fout,
          const size_t fstride,
          const kiss_fft_cfg st,
@@ -133,7 +133,7 @@ static void kf_bfly3(
      }while(--k);
 }
 
-static void kf_bfly5(
+static void HOT_FUNC(kf_bfly5)(
         kiss_fft_cpx * Fout,
         const size_t fstride,
         const kiss_fft_cfg st,
@@ -195,7 +195,7 @@ static void kf_bfly5(
 }
 
 /* perform the butterfly for one stage of a mixed radix FFT */
-static void kf_bfly_generic(
+static void HOT_FUNC(kf_bfly_generic)(
         kiss_fft_cpx * Fout,
         const size_t fstride,
         const kiss_fft_cfg st,
@@ -235,7 +235,7 @@ static void kf_bfly_generic(
 }
 
 static
-void kf_work(
+void HOT_FUNC(kf_work)(
         kiss_fft_cpx * Fout,
         const kiss_fft_cpx * f,
         const size_t fstride,
@@ -368,7 +368,7 @@ kiss_fft_cfg kiss_fft_alloc(int nfft,int inverse_fft,void * mem,size_t * lenmem
 }
 
 
-void kiss_fft_stride(kiss_fft_cfg st,const kiss_fft_cpx *fin,kiss_fft_cpx *fout,int in_stride)
+void HOT_FUNC(kiss_fft_stride)(kiss_fft_cfg st,const kiss_fft_cpx *fin,kiss_fft_cpx *fout,int in_stride)
 {
     if (fin == fout) {
         //NOTE: this is not really an in-place FFT algorithm.
@@ -0,0 +1,156 @@
+import argparse
+import struct
+import sys
+import time
+
+import numpy as np
+
+# Reads the binary spectrum frames of adc_fft built with SPECTRUM_TELEMETRY
+# (see the comment above struct telemetry in adc_fft.c) from the Pico's
+# serial port, a saved capture or stdin, and plots them live as a spectrum
+# and a waterfall, and/or stores them as CSV.
+#
+#   python3 spectrum.py /dev/tty.usbmodem21301 --bands 64
+#   python3 spectrum.py capture.bin --save spectra.csv --no-plot
+
+SYNC = b"\xa5\x5a"
+HEADER = struct.Struct("<BBHHHI")   # flags, q, seq, count, nsamp, fsamp (mHz)
+DB_PER_LOG2 = 10 * np.log10(2)
+
+def fletcher16(data):
+    c0 = c1 = 0
+    for b in data:
+        c0 = (c0 + b) % 255
+        c1 = (c1 + c0) % 255
+    return c1 << 8 | c0
+
+class Frame:
+    def __init__(self, header, values):
+        flags, self.q, self.seq, count, self.nsamp, mhz = header
+        self.fsamp = mhz / 1000
+        # a full scale sine (128 codes) gives |X| = 64 nsamp in its bin
+        full_scale = 20 * np.log10(64 * self.nsamp)
+        self.dbfs = values / (1 << self.q) * DB_PER_LOG2 - full_scale
+        # centre of each band, in Hz
+        bins = self.nsamp // 2
+        edges = np.arange(count + 1) * bins // count
+        self.freqs = (edges[:-1] + edges[1:] - 1) / 2 * self.fsamp / self.nsamp
+
+# Yields every frame with a good checksum, skipping text and damaged frames
+def frames(stream, stats):
+    buf = bytearray()
+    while True:
+        data = stream.read(4096)
+        if not data:
+            return
+        buf += data
+        while True:
+            start = buf.find(SYNC)
+            if start < 0:
+                del buf[:-1]
+                break
+            del buf[:start]
+            if len(buf) < 2 + HEADER.size:
+                break
+            header = HEADER.unpack_from(buf, 2)
+            wide = header[0] & 1
+            size = 2 + HEADER.size + header[3] * (2 if wide else 1) + 2
+            if len(buf) < size:
+                break
+            body = bytes(buf[2:size - 2])
+            check, = struct.unpack_from("<H", buf, size - 2)
+            if fletcher16(body) != check:
+                stats["bad"] += 1
+                del buf[:2]     # a sync pattern that wasn't a frame
+                continue
+            dt = np.dtype("<u2" if wide else "u1")
+            values = np.frombuffer(body, dtype=dt, offset=HEADER.size).astype(float)
+            del buf[:size]
+            yield Frame(header, values)
+
+def open_source(path, args):
+    if path == "-":
+        return sys.stdin.buffer
+    if path.startswith("/dev/") or path.upper().startswith("COM"):
+        import serial
+        port = serial.Serial(path, 115200, timeout=0.1)
+        for cmd in ("bands %d" % args.bands if args.bands is not None else None,
+                    "bits %d" % args.bits if args.bits else None):
+            if cmd:
+                port.write((cmd + "\n").encode())
+        return port
+    return open(path, "rb")
+
+if __name__=="__main__":
+    parser = argparse.ArgumentParser(description="Live spectrum from adc_fft")
+    parser.add_argument("source", help="serial port, capture file or - for stdin")
+    parser.add_argument("--bands", type=int, help="bands to ask for, 0 for every bin")
+    parser.add_argument("--bits", type=int, choices=(8, 16), help="value size to ask for")
+    parser.add_argument("--save", help="append each frame to this CSV file")
+    parser.add_argument("--no-plot", action="store_true", help="only store frames")
+    parser.add_argument("--rows", type=int, default=200, help="waterfall history")
+    args = parser.parse_args()
+
+    stats = {"bad": 0, "dropped": 0, "frames": 0}
+    out = open(args.save, "a") if args.save else None
+
+    if not args.no_plot:
+        import matplotlib.pyplot as plt
+        plt.ion()
+        fig, (ax_spec, ax_fall) = plt.subplots(2, 1, figsize=(9, 7))
+        line = None
+
+    last_seq = None
+    last_draw = 0
+    started = time.time()
+    for frame in frames(open_source(args.source, args), stats):
+        stats["frames"] += 1
+        if last_seq is not None:
+            stats["dropped"] += (frame.seq - last_seq - 1) & 0xffff
+        last_seq = frame.seq
+
+        if out:
+            out.write("%d,%0.3f,%0.1f,%d,%s\n" % (
+                frame.seq, time.time(), frame.fsamp, frame.nsamp,
+                ",".join("%0.2f" % v for v in frame.dbfs)))
+
+        if args.no_plot:
+            continue
+
+        # a change of rate, block size or bands starts the plot again
+        if line is None or len(line.get_xdata()) != len(frame.freqs) \
+           or line.get_xdata()[-1] != frame.freqs[-1]:
+            ax_spec.clear()
+            line, = ax_spec.plot(frame.freqs, frame.dbfs, linewidth=0.8)
+            ax_spec.set_ylim(-120, 0)
+            ax_spec.set_xlabel("Frequency (Hz)")
+            ax_spec.set_ylabel("dBFS")
+            fall = np.full((args.rows, len(frame.freqs)), -120.0)
+            ax_fall.clear()
+            image = ax_fall.imshow(fall, aspect="auto", vmin=-120, vmax=0,
+                                   extent=(0, frame.fsamp / 2, args.rows, 0))
+            ax_fall.set_xlabel("Frequency (Hz)")
+            ax_fall.set_ylabel("Frames ago")
+
+        fall = np.roll(fall, 1, axis=0)
+        fall[0] = frame.dbfs
+
+        # drawing is much slower than the frames arrive, so draw at ~20 fps
+        now = time.time()
+        if now - last_draw < 0.05:
+            continue
+        last_draw = now
+        line.set_ydata(frame.dbfs)
+        image.set_data(fall)
+        ax_spec.set_title("%0.1f Hz, NSAMP %d, %d values, %0.1f frames/s" % (
+            frame.fsamp, frame.nsamp, len(frame.dbfs),
+            stats["frames"] / (now - started)))
+        plt.pause(0.001)
+
+    print("%d frames, %d dropped, %d damaged" %
+          (stats["frames"], stats["dropped"], stats["bad"]), file=sys.stderr)
+    if out:
+        out.close()
+    if not args.no_plot and line is not None:
+        plt.ioff()
+        plt.show()
@@ -0,0 +1,201 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if BENCH_SYSTICK
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "hardware/structs/xip_ctrl.h"
+#else
+#include <chrono>
+#endif
+
+namespace bench {
+
+// ############ Clocks ############
+
+#if BENCH_SYSTICK
+// SysTick is 24 bits wide and counts down once per processor clock, so
+// one reading can only span 2^24 cycles (134 ms at 125 MHz). Anything
+// longer falls back to the microsecond timer scaled by clk_sys.
+#define SYSTICK_MASK 0xffffff
+#define SYSTICK_MAX_US 100000
+
+static void clock_init() {
+  systick_hw->rvr = SYSTICK_MASK;
+  systick_hw->cvr = 0;
+  systick_hw->csr = 0x5; // enable, processor clock, no interrupt
+}
+
+static inline uint64_t now_ns() { return time_us_64() * 1000; }
+static inline uint32_t now_cycles() { return systick_hw->cvr; }
+
+static uint64_t cycles_between(uint32_t c0, uint32_t c1, uint64_t ns) {
+  if (ns / 1000 >= SYSTICK_MAX_US)
+    return ns * (clock_get_hz(clk_sys) / 1000000) / 1000;
+  return (c0 - c1) & SYSTICK_MASK;
+}
+#else
+static void clock_init() {}
+
+static inline uint64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+static inline uint32_t now_cycles() { return 0; }
+
+static uint64_t cycles_between(uint32_t, uint32_t, uint64_t) { return 0; }
+#endif
+
+#if BENCH_SYSTICK && BENCH_COLD_CACHE
+// Empties the XIP cache, so code and constants in flash are fetched over
+// QSPI again as they would be after the model has run
+static void flush_cache() {
+  xip_ctrl_hw->flush = 1;
+  // reading FLUSH stalls until the flush has finished
+  (void)xip_ctrl_hw->flush;
+}
+#else
+static void flush_cache() {}
+#endif
+
+// ############ State ############
+
+State::State(int64_t arg, uint64_t max_iterations) :
+  arg(arg), max_iterations(max_iterations), done(0), started(false),
+  items(0), bytes(0), ns(0), cycles(0), t0(0), c0(0) {}
+
+void State::start() {
+  t0 = now_ns();
+  c0 = now_cycles();
+}
+
+void State::stop() {
+  uint32_t c1 = now_cycles();
+  uint64_t t = now_ns() - t0;
+  ns += t;
+  cycles += cycles_between(c0, c1, t);
+}
+
+bool State::KeepRunning() {
+  if (started) {
+    // each iteration is timed on its own so SysTick never wraps twice
+    stop();
+    done++;
+  }
+  started = true;
+  if (done >= max_iterations) return false;
+  flush_cache();
+  start();
+  return true;
+}
+
+void State::PauseTiming() { stop(); }
+void State::ResumeTiming() { start(); }
+
+// ############ Registry ############
+
+static std::vector<Benchmark *> &registry() {
+  static std::vector<Benchmark *> r;
+  return r;
+}
+
+Benchmark::Benchmark(const char *name, Function fn) : name(name), fn(fn) {}
+
+Benchmark *Benchmark::Arg(int64_t n) {
+  args.push_back(n);
+  return this;
+}
+
+Benchmark *RegisterBenchmark(const char *name, Function fn) {
+  Benchmark *b = new Benchmark(name, fn);
+  registry().push_back(b);
+  return b;
+}
+
+// ############ Runner ############
+
+static void print_result(const char *name, int64_t arg, const State &s,
+                         bool first) {
+  double per_iter = (double)s.elapsed_ns() / s.iterations();
+  double secs = s.elapsed_ns() / 1e9;
+
+  printf("%s    {\n", first ? "" : ",\n");
+  printf("      \"name\": \"%s/%lld\",\n", name, (long long)arg);
+  printf("      \"iterations\": %llu,\n", (unsigned long long)s.iterations());
+  printf("      \"real_time\": %.1f,\n", per_iter);
+  printf("      \"time_unit\": \"ns\"");
+#if BENCH_SYSTICK
+  printf(",\n      \"cycles\": %.1f",
+         (double)s.elapsed_cycles() / s.iterations());
+#endif
+  if (s.items_processed() && secs > 0)
+    printf(",\n      \"items_per_second\": %.1f", s.items_processed() / secs);
+  if (s.bytes_processed() && secs > 0)
+    printf(",\n      \"bytes_per_second\": %.1f", s.bytes_processed() / secs);
+  std::map<std::string, double>::const_iterator it;
+  for (it = s.counters.begin(); it != s.counters.end(); ++it)
+    printf(",\n      \"%s\": %.3f", it->first.c_str(), it->second);
+  printf("\n    }");
+}
+
+int RunAll(const char *filter, double min_time_s) {
+  int run = 0;
+  uint64_t min_ns = (uint64_t)(min_time_s * 1e9);
+
+  clock_init();
+
+  printf("{\n  \"context\": {\n");
+#if BENCH_SYSTICK
+  printf("    \"target\": \"rp2040\",\n");
+  printf("    \"mhz_per_cpu\": %lu,\n",
+         (unsigned long)(clock_get_hz(clk_sys) / 1000000));
+  printf("    \"timer\": \"systick\",\n");
+#if HOT_IN_RAM
+  printf("    \"hot_in_ram\": true,\n");
+#else
+  printf("    \"hot_in_ram\": false,\n");
+#endif
+#if BENCH_COLD_CACHE
+  printf("    \"xip_cache\": \"cold\"\n");
+#else
+  printf("    \"xip_cache\": \"warm\"\n");
+#endif
+#else
+  printf("    \"target\": \"host\",\n");
+  printf("    \"timer\": \"steady_clock\"\n");
+#endif
+  printf("  },\n  \"benchmarks\": [\n");
+
+  std::vector<Benchmark *> &r = registry();
+  for (size_t i = 0; i < r.size(); i++) {
+    Benchmark *b = r[i];
+    if (b->args.empty()) b->args.push_back(0);
+    for (size_t j = 0; j < b->args.size(); j++) {
+      char full[64];
+      snprintf(full, sizeof(full), "%s/%lld", b->name.c_str(),
+               (long long)b->args[j]);
+      if (filter && !strstr(full, filter)) continue;
+
+      // one iteration to estimate the cost, then enough to fill min_ns
+      State probe(b->args[j], 1);
+      b->fn(probe);
+      uint64_t each = probe.elapsed_ns() ? probe.elapsed_ns() : 1;
+      uint64_t n = min_ns / each + 1;
+      if (n > 1000000) n = 1000000;
+
+      State s(b->args[j], n);
+      b->fn(s);
+      print_result(b->name.c_str(), b->args[j], s, run == 0);
+      run++;
+    }
+  }
+
+  printf("\n  ]\n}\n");
+  fflush(stdout);
+  return run;
+}
+
+}
@@ -0,0 +1,97 @@
+// Small benchmark harness in the style of Google Benchmark, sized to
+// run on the RP2040 as well as on a host. Kernels register themselves
+// with BENCHMARK(fn)->Arg(n) and loop on state.KeepRunning(); the
+// runner picks an iteration count that fills a minimum time and prints
+// the results as JSON.
+//
+// On the device (BENCH_SYSTICK=1) every iteration is timed with the
+// Cortex-M0+ SysTick counter, which counts processor clocks, so the
+// report carries cycles per iteration as well as nanoseconds.
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+class State {
+ public:
+  State(int64_t arg, uint64_t max_iterations);
+
+  // true while more iterations are wanted; starts and stops the clock
+  bool KeepRunning();
+
+  // stop the clock around per-iteration setup that should not count
+  void PauseTiming();
+  void ResumeTiming();
+
+  // benchmarks take one argument, so only range(0) is meaningful
+  int64_t range(int = 0) const { return arg; }
+  uint64_t iterations() const { return done; }
+
+  void SetItemsProcessed(int64_t n) { items = n; }
+  void SetBytesProcessed(int64_t n) { bytes = n; }
+
+  int64_t items_processed() const { return items; }
+  int64_t bytes_processed() const { return bytes; }
+  uint64_t elapsed_ns() const { return ns; }
+  uint64_t elapsed_cycles() const { return cycles; }
+
+  // extra figures to report alongside the timing, e.g. a measured SNR
+  std::map<std::string, double> counters;
+
+ private:
+  void start();
+  void stop();
+
+  int64_t arg;
+  uint64_t max_iterations;
+  uint64_t done;
+  bool started;
+  int64_t items;
+  int64_t bytes;
+  uint64_t ns;
+  uint64_t cycles;
+  uint64_t t0;
+  uint32_t c0;
+};
+
+typedef void (*Function)(State &);
+
+class Benchmark {
+ public:
+  Benchmark(const char *name, Function fn);
+  Benchmark *Arg(int64_t n);
+
+  std::string name;
+  Function fn;
+  std::vector<int64_t> args;
+};
+
+Benchmark *RegisterBenchmark(const char *name, Function fn);
+
+// Runs every benchmark whose name contains filter (all of them if NULL)
+// and writes the JSON report to stdout. Returns the number run.
+int RunAll(const char *filter = NULL, double min_time_s = 0.5);
+
+// Keeps the compiler from discarding a result that is never used
+template <class T> inline void DoNotOptimize(T const &value) {
+  asm volatile("" : : "r,m"(value) : "memory");
+}
+
+inline void ClobberMemory() { asm volatile("" : : : "memory"); }
+
+}
+
+#define BENCH_CONCAT2(a, b) a##b
+#define BENCH_CONCAT(a, b) BENCH_CONCAT2(a, b)
+#define BENCHMARK(fn) \
+  static ::bench::Benchmark *BENCH_CONCAT(bench_reg_, __LINE__) = \
+    ::bench::RegisterBenchmark(#fn, fn)
+
+#endif
@@ -0,0 +1,363 @@
+// The per-buffer kernels of the programs in this repository, at the
+// sizes the programs use them:
+//   NSAMP  1000  adc_fft, pico-light-voice
+//   NSAMP  5000  pico-voice-v1
+//   NSAMP 10000  adc_time, pico-daq
+//   INSIZE 4000  pico-light-voice model input and log-mel window
+//   60 pixels    pico-light-voice light strip
+//   1000 raw     pico-voice-v1 OVERSAMPLE DMA block at 500 kS/s
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "bench.h"
+#include "kiss_fftr.h"
+#include "base64.h"
+#include "decimator.h"
+#include "logmel.h"
+#include "feature_prep.h"
+#include "scale.h"
+#include "Adafruit_NeoPixel.hpp"
+
+#define MAX_SAMP 10000
+#define NUM_PIXELS 60
+
+uint16_t samples[MAX_SAMP];
+float work[MAX_SAMP];
+
+// ADC-like input: a 12-bit tone around mid-scale with a little noise
+static void fill_samples(uint32_t n) {
+  uint32_t seed = 1;
+  for (uint32_t i = 0; i < n; i++) {
+    seed = seed * 1664525 + 1013904223;
+    samples[i] = 2048 + (int)(1000 * sinf(i * 0.3f)) + (int)(seed >> 28) - 8;
+  }
+}
+
+// ############ FFT ############
+
+static void BM_kiss_fftr(bench::State &state) {
+  uint32_t n = state.range(0);
+  kiss_fftr_cfg cfg = kiss_fftr_alloc(n, false, 0, 0);
+  kiss_fft_cpx *out = (kiss_fft_cpx *)malloc(sizeof(kiss_fft_cpx) * (n/2+1));
+
+  fill_samples(n);
+  for (uint32_t i = 0; i < n; i++) work[i] = samples[i];
+
+  while (state.KeepRunning()) {
+    kiss_fftr(cfg, work, out);
+    bench::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+
+  free(out);
+  kiss_fft_free(cfg);
+}
+BENCHMARK(BM_kiss_fftr)->Arg(1000)->Arg(5000)->Arg(10000);
+
+// ############ Encoding ############
+
+// pico-daq sends each buffer of NSAMP floats as base64
+static void BM_base64_encode(bench::State &state) {
+  uint32_t n = state.range(0);
+
+  fill_samples(n);
+  for (uint32_t i = 0; i < n; i++) work[i] = samples[i] / 2048.0f - 1;
+
+  while (state.KeepRunning()) {
+    std::string encoded = base64_encode((unsigned char const *)work, n*4);
+    bench::DoNotOptimize(encoded.data());
+  }
+  state.SetBytesProcessed(state.iterations() * n * 4);
+}
+BENCHMARK(BM_base64_encode)->Arg(1000)->Arg(5000)->Arg(10000);
+
+// ############ Normalization ############
+
+// pico-daq's min/max scaling to [-1, 1] of one channel, here the only
+// one, as with the default CAPTURE_MASK
+static void BM_scale_channel(bench::State &state) {
+  uint32_t n = state.range(0);
+
+  fill_samples(n);
+
+  while (state.KeepRunning()) {
+    scale_channel(strided<uint16_t>{samples, 1}, strided<float>{work, 1}, n);
+    bench::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_scale_channel)->Arg(10000);
+
+// pico-light-voice's scaling of the model's window to its input range
+static void BM_normalize_window(bench::State &state) {
+  uint32_t n = state.range(0);
+
+  fill_samples(n);
+
+  while (state.KeepRunning()) {
+    normalize_window(samples, work, n);
+    bench::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_normalize_window)->Arg(INSIZE);
+
+// ############ Decimation ############
+
+// pico-voice-v1's OVERSAMPLE build: the ADC at 500 kS/s, decimated by
+// 25 in the CIC and 4 in the FIR to 5 kHz
+#define OS_RATE 500000
+#define OUT_RATE 5000
+#define OS_CIC_R 25
+#define OS_FIR_R 4
+#define OS_TAPS 32
+#define ENOB_N 2048
+#define ENOB_SETTLE 64   // outputs dropped while the FIR fills
+#define SIGNAL_BINS 3    // Hann window main lobe either side of a peak
+#define TONE_HZ 437
+
+static decimator_t decim;
+
+// one ADC code of a tone with about 1.2 LSB rms of noise on it; phase
+// is a 32-bit accumulator advanced by step per sample
+static uint16_t noisy_tone(uint32_t *phase, uint32_t step, uint32_t *seed) {
+  float v = 2048 + 1500 * sinf(*phase * (2 * (float)M_PI / 4294967296.0f));
+  *phase += step;
+  for (int k = 0; k < 2; k++) {
+    *seed = *seed * 1664525 + 1013904223;
+    v += (*seed >> 8) * (3.0f / 16777216) - 1.5f;
+  }
+  return (uint16_t)lroundf(v);
+}
+
+// effective bits of ENOB_N samples, from a Hann windowed FFT with the
+// tone's bins as signal and everything else but DC as noise
+static float enob(float *x, kiss_fftr_cfg cfg, kiss_fft_cpx *out) {
+  double sum = 0;
+  for (int i = 0; i < ENOB_N; i++) sum += x[i];
+  float avg = sum / ENOB_N;
+  for (int i = 0; i < ENOB_N; i++)
+    x[i] = (x[i] - avg) * (0.5f - 0.5f * cosf(2 * (float)M_PI * i / ENOB_N));
+  kiss_fftr(cfg, x, out);
+
+  // power spectrum in place over the input
+  int peak = SIGNAL_BINS + 1;
+  for (int i = 0; i <= ENOB_N/2; i++) {
+    x[i] = out[i].r*out[i].r + out[i].i*out[i].i;
+    if (i > SIGNAL_BINS && x[i] > x[peak]) peak = i;
+  }
+  double signal = 0, noise = 0;
+  for (int i = SIGNAL_BINS + 1; i <= ENOB_N/2; i++) {
+    if (abs(i - peak) <= SIGNAL_BINS) signal += x[i];
+    else noise += x[i];
+  }
+  return (10 * log10(signal / noise) - 1.76f) / 6.02f;
+}
+
+// The same tone and noise sampled directly at OUT_RATE and oversampled
+// through the decimator
+static void measure_bits_gained(bench::State &state) {
+  kiss_fftr_cfg cfg = kiss_fftr_alloc(ENOB_N, false, 0, 0);
+  kiss_fft_cpx *out = (kiss_fft_cpx *)malloc(sizeof(kiss_fft_cpx) * (ENOB_N/2+1));
+  uint32_t phase = 0, seed = 1;
+  uint32_t step = (uint32_t)((double)TONE_HZ / OUT_RATE * 4294967296.0);
+
+  for (int i = 0; i < ENOB_N; i++) work[i] = noisy_tone(&phase, step, &seed);
+  float direct = enob(work, cfg, out);
+
+  decimator_init(&decim, OS_CIC_R, OS_FIR_R, OS_TAPS);
+  phase = 0;
+  step = (uint32_t)((double)TONE_HZ / OS_RATE * 4294967296.0);
+  int16_t dec[1000 / (OS_CIC_R * OS_FIR_R) + 1];
+  uint32_t got = 0;
+  while (got < ENOB_SETTLE + ENOB_N) {
+    for (int i = 0; i < 1000; i++) samples[i] = noisy_tone(&phase, step, &seed);
+    uint32_t m = decimator_process(&decim, samples, 1000, dec);
+    for (uint32_t k = 0; k < m; k++, got++) {
+      if (got >= ENOB_SETTLE && got < ENOB_SETTLE + ENOB_N)
+        work[got - ENOB_SETTLE] = dec[k] / (float)(1 << DECIM_FRAC_BITS);
+    }
+  }
+  float decimated = enob(work, cfg, out);
+
+  state.counters["enob_direct"] = direct;
+  state.counters["enob_decimated"] = decimated;
+  state.counters["bits_gained"] = decimated - direct;
+
+  free(out);
+  kiss_fft_free(cfg);
+}
+
+// raw samples per second one core can decimate, and the share of a core
+// it takes at OS_RATE
+static void BM_decimate(bench::State &state) {
+  uint32_t n = state.range(0);
+  int16_t *out = (int16_t *)malloc(sizeof(int16_t) * (n / (OS_CIC_R * OS_FIR_R) + 1));
+
+  fill_samples(n);
+  decimator_init(&decim, OS_CIC_R, OS_FIR_R, OS_TAPS);
+
+  while (state.KeepRunning()) {
+    bench::DoNotOptimize(decimator_process(&decim, samples, n, out));
+    bench::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+
+  double ns_per_sample = (double)state.elapsed_ns() / state.iterations() / n;
+  state.counters["core_load_at_500k"] = ns_per_sample * OS_RATE / 1e9;
+  measure_bits_gained(state);
+  free(out);
+}
+BENCHMARK(BM_decimate)->Arg(1000);
+
+// ############ Log-mel front end ############
+
+// pico-light-voice's LOGMEL_TIMING build: int8 log-mel features of a
+// model window at 4 kHz, to set against the SDK's DSP time for the same
+// window
+int16_t logmel[LOGMEL_FRAMES(MAX_SAMP) * LOGMEL_FILTERS];
+int8_t logmel_q[LOGMEL_FRAMES(MAX_SAMP) * LOGMEL_FILTERS];
+int16_t mfcc[LOGMEL_FRAMES(MAX_SAMP) * LOGMEL_CEPS];
+
+static void BM_logmel(bench::State &state) {
+  uint32_t n = state.range(0);
+
+  fill_samples(n);
+  logmel_init(4000, 0, 2000);
+
+  while (state.KeepRunning()) {
+    uint32_t frames = logmel_compute(samples, n, logmel);
+    logmel_quantize(logmel, frames * LOGMEL_FILTERS, logmel_q);
+    bench::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_logmel)->Arg(4000);
+
+// the DCT on top, per window
+static void BM_mfcc(bench::State &state) {
+  uint32_t n = state.range(0);
+
+  fill_samples(n);
+  logmel_init(4000, 0, 2000);
+  uint32_t frames = logmel_compute(samples, n, logmel);
+
+  while (state.KeepRunning()) {
+    logmel_mfcc(logmel, frames, mfcc);
+    bench::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * frames);
+}
+BENCHMARK(BM_mfcc)->Arg(4000);
+
+// ############ NeoPixel colour ############
+
+// Exposes the frame conversion show() runs before each transfer
+class BenchStrip : public Adafruit_NeoPixel {
+ public:
+  BenchStrip(uint16_t n, int16_t pin, neoPixelType type) :
+    Adafruit_NeoPixel(n, pin, type) {}
+  bool render(void) { return renderFront(); }
+};
+
+// Never destroyed and never begun: the destructor and show() would start
+// the PIO and DMA, which these benchmarks do not need
+static BenchStrip &strip() {
+  static BenchStrip *s = NULL;
+  if (!s) {
+    s = new BenchStrip(NUM_PIXELS, 0, NEO_GRB + NEO_KHZ800);
+    s->setBrightness(64);
+  }
+  return *s;
+}
+
+static void BM_setPixelColor(bench::State &state) {
+  BenchStrip &s = strip();
+  uint16_t n = state.range(0);
+  uint32_t c = 0;
+
+  while (state.KeepRunning()) {
+    for (uint16_t i = 0; i < n; i++) s.setPixelColor(i, c++);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_setPixelColor)->Arg(NUM_PIXELS);
+
+static void BM_fill(bench::State &state) {
+  BenchStrip &s = strip();
+  uint16_t n = state.range(0);
+  uint32_t c = 0;
+
+  while (state.KeepRunning()) {
+    s.fill(c++, 0, n);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_fill)->Arg(NUM_PIXELS);
+
+// the rainbow effect: one ColorHSV() and gamma32() per pixel, against
+// the span routine that does the same thing
+static void BM_ColorHSV_gamma32(bench::State &state) {
+  BenchStrip &s = strip();
+  uint16_t n = state.range(0);
+  uint16_t hue = 0;
+
+  while (state.KeepRunning()) {
+    for (uint16_t i = 0; i < n; i++) {
+      s.setPixelColor(i, Adafruit_NeoPixel::gamma32(
+                           Adafruit_NeoPixel::ColorHSV(hue + i * 1092)));
+    }
+    hue += 256;
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_ColorHSV_gamma32)->Arg(NUM_PIXELS);
+
+static void BM_fillHSV(bench::State &state) {
+  BenchStrip &s = strip();
+  uint16_t n = state.range(0);
+  uint16_t hues[NUM_PIXELS];
+
+  for (uint16_t i = 0; i < n; i++) hues[i] = i * 1092;
+
+  while (state.KeepRunning()) {
+    s.fillHSV(0, n, hues, 255, 255, true);
+    for (uint16_t i = 0; i < n; i++) hues[i] += 256;
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_fillHSV)->Arg(NUM_PIXELS);
+
+static void BM_gammaSpan(bench::State &state) {
+  uint16_t n = state.range(0);
+  uint32_t colors[NUM_PIXELS];
+  uint32_t c = 0x123456;
+
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    for (uint16_t i = 0; i < n; i++) colors[i] = c += 0x010305;
+    state.ResumeTiming();
+    Adafruit_NeoPixel::gammaSpan(colors, n);
+    bench::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_gammaSpan)->Arg(NUM_PIXELS);
+
+// brightness lookup of a full frame into the front buffer
+static void BM_renderFront(bench::State &state) {
+  BenchStrip &s = strip();
+  uint16_t n = state.range(0);
+  uint32_t c = 0;
+
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    s.fill(c++, 0, n);
+    state.ResumeTiming();
+    bench::DoNotOptimize(s.render());
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_renderFront)->Arg(NUM_PIXELS);
@@ -0,0 +1,32 @@
+// Runs the benchmark suite and prints the report as JSON. On the host,
+// --filter=<substring> selects benchmarks and --min_time=<seconds> sets
+// how long each one runs.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "bench.h"
+
+int main(int argc, char **argv) {
+  const char *filter = NULL;
+  double min_time = 0.5;
+
+  for (int i = 1; i < argc; i++) {
+    if (!strncmp(argv[i], "--filter=", 9)) filter = argv[i] + 9;
+    else if (!strncmp(argv[i], "--min_time=", 11)) min_time = atof(argv[i] + 11);
+  }
+
+  stdio_init_all();
+
+#if BENCH_SYSTICK
+  // give the USB serial port time to enumerate, then repeat the run so
+  // a terminal opened late still catches a full report
+  while (true) {
+    sleep_ms(5000);
+    bench::RunAll(filter, min_time);
+  }
+#else
+  return bench::RunAll(filter, min_time) ? 0 : 1;
+#endif
+}
@@ -0,0 +1,50 @@
+# Compares two benchmark reports and lists the benchmarks that got
+# slower. Exits with status 1 if any slowed down by more than the
+# threshold, so it can gate a build.
+#
+#   python3 compare.py baseline.json new.json [threshold_percent]
+
+import json
+import sys
+
+def load(path):
+    # the device prints other serial output around the report; keep the
+    # last complete JSON object
+    text = open(path, "r").read()
+    start = text.rfind('{\n  "context"')
+    end = text.rfind("}")
+    return json.loads(text[start:end+1])
+
+if __name__=="__main__":
+    if len(sys.argv) < 3:
+        print("usage: compare.py baseline.json new.json [threshold_percent]")
+        sys.exit(2)
+
+    old = load(sys.argv[1])
+    new = load(sys.argv[2])
+    threshold = float(sys.argv[3]) if len(sys.argv) > 3 else 5.0
+
+    # cycles are exact on the device, so prefer them when both have them
+    key = "real_time"
+    if all("cycles" in b for b in old["benchmarks"] + new["benchmarks"]):
+        key = "cycles"
+
+    before = {b["name"]: b[key] for b in old["benchmarks"]}
+    regressions = 0
+
+    print("%-28s %14s %14s %12s %8s" %
+          ("benchmark", "old " + key, "new " + key, "delta", "change"))
+    for b in new["benchmarks"]:
+        if b["name"] not in before:
+            print("%-28s %14s %14.1f %12s %8s" % (b["name"], "-", b[key], "-", "new"))
+            continue
+        change = (b[key] - before[b["name"]]) / before[b["name"]] * 100
+        flag = ""
+        if change > threshold:
+            flag = "  SLOWER"
+            regressions += 1
+        print("%-28s %14.1f %14.1f %+12.1f %+7.1f%%%s" %
+              (b["name"], before[b["name"]], b[key], b[key] - before[b["name"]],
+               change, flag))
+
+    sys.exit(1 if regressions else 0)
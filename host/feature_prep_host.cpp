@@ -0,0 +1,75 @@
+// Runs pico-light-voice's feature preparation on its own, in place of
+// main.cpp's keyword spotting loop, and prints what the model would be
+// given. Samples are taken the way main.cpp takes them: NSAMP at a time
+// by DMA from the ADC, slid into a window of INSIZE. Once the window is
+// full, each block prints it as
+//
+//   norm      the normalized window (normalize_window)
+//   logmel    the native front end's log-mel rows (logmel_compute)
+//
+// chosen by the first argument. The program ends when the ADC input file
+// runs out.
+
+#include <hardware/adc.h>
+#include <hardware/dma.h>
+#include <pico/stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "feature_prep.h"
+#include "logmel.h"
+
+// as in main.cpp
+#define CLOCK_DIV 12000
+
+static float features[INSIZE];
+static uint16_t capture_buf[NSAMP];
+static uint16_t intermediate_buf[INSIZE];
+static int16_t logmel[LOGMEL_FRAMES(INSIZE) * LOGMEL_FILTERS];
+
+int main(int argc, char **argv) {
+  bool use_logmel = argc > 1 && !strcmp(argv[1], "logmel");
+  stdio_init_all();
+  // INSIZE samples is one second, so it is also the sample rate
+  logmel_init(INSIZE, 0, INSIZE / 2);
+
+  adc_init();
+  adc_select_input(0);
+  adc_fifo_setup(true, true, 1, false, false);
+  adc_set_clkdiv(CLOCK_DIV);
+
+  uint dma_chan = dma_claim_unused_channel(true);
+  dma_channel_config cfg = dma_channel_get_default_config(dma_chan);
+  channel_config_set_transfer_data_size(&cfg, DMA_SIZE_16);
+  channel_config_set_read_increment(&cfg, false);
+  channel_config_set_write_increment(&cfg, true);
+  channel_config_set_dreq(&cfg, DREQ_ADC);
+
+  for (uint32_t block = 1; ; block++) {
+    adc_fifo_drain();
+    adc_run(false);
+    dma_channel_configure(dma_chan, &cfg, capture_buf, &adc_hw->fifo,
+			  NSAMP, true);
+    adc_run(true);
+    dma_channel_wait_for_finish_blocking(dma_chan);
+
+    memmove(intermediate_buf, intermediate_buf + NSAMP,
+	    (INSIZE - NSAMP) * sizeof(uint16_t));
+    memcpy(intermediate_buf + INSIZE - NSAMP, capture_buf,
+	   NSAMP * sizeof(uint16_t));
+    if (block * NSAMP < INSIZE) continue;
+
+    printf("window %u\n", (unsigned)(block * NSAMP - INSIZE));
+    if (use_logmel) {
+      uint32_t frames = logmel_compute(intermediate_buf, INSIZE, logmel);
+      for (uint32_t t = 0; t < frames; t++) {
+	for (int f = 0; f < LOGMEL_FILTERS; f++)
+	  printf("%d ", logmel[t * LOGMEL_FILTERS + f]);
+	printf("\n");
+      }
+    } else {
+      normalize_window(intermediate_buf, features, INSIZE);
+      for (uint32_t i = 0; i < INSIZE; i++)
+	printf("%.2f%c", features[i], i % 10 == 9 ? '\n' : ' ');
+    }
+  }
+}
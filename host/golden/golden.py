@@ -0,0 +1,115 @@
+import argparse
+import os
+import struct
+import subprocess
+import sys
+
+# Runs a host program on a recording and compares its output with a
+# stored reference, number by number, within a tolerance. Words that
+# aren't numbers must match exactly, and so must the number of lines.
+#
+#   golden.py --input tones.wav --expected adc_fft.txt --tol 50 -- build/adc_fft
+#
+# --frames decodes adc_fft's binary spectrum frames (SPECTRUM_TELEMETRY)
+# to one line of dB values per frame before comparing. --update writes
+# the output as the new reference instead.
+
+DB_PER_LOG2 = 3.0103
+
+def fletcher16(data):
+    c0 = c1 = 0
+    for b in data:
+        c0 = (c0 + b) % 255
+        c1 = (c1 + c0) % 255
+    return c1 << 8 | c0
+
+# Frames are laid out as described above struct telemetry in adc_fft.c
+def decode_frames(data):
+    lines = []
+    i = 0
+    while True:
+        i = data.find(b"\xa5\x5a", i)
+        if i < 0 or i + 14 > len(data):
+            break
+        flags, q, seq, count, nsamp, mhz = struct.unpack_from("<BBHHHI", data, i + 2)
+        width = 2 if flags & 1 else 1
+        end = i + 14 + count * width + 2
+        if end > len(data):
+            break
+        if fletcher16(data[i + 2:end - 2]) != struct.unpack_from("<H", data, end - 2)[0]:
+            i += 2
+            continue
+        values = struct.unpack_from("<%d%s" % (count, "H" if width == 2 else "B"), data, i + 14)
+        lines.append("frame %d nsamp %d fsamp %.3f: %s" % (
+            seq, nsamp, mhz / 1000,
+            " ".join("%.2f" % (v / (1 << q) * DB_PER_LOG2) for v in values)))
+        i = end
+    return "\n".join(lines) + "\n"
+
+def number(word):
+    try:
+        return float(word)
+    except ValueError:
+        return None
+
+# Returns a description of the first few differences
+def compare(expected, actual, tol):
+    exp_lines = expected.splitlines()
+    act_lines = actual.splitlines()
+    problems = []
+    if len(exp_lines) != len(act_lines):
+        problems.append("%d lines, expected %d" % (len(act_lines), len(exp_lines)))
+    worst = 0
+    for n, (e, a) in enumerate(zip(exp_lines, act_lines), 1):
+        ew, aw = e.split(), a.split()
+        if len(ew) != len(aw):
+            problems.append("line %d: %d words, expected %d" % (n, len(aw), len(ew)))
+            continue
+        for x, y in zip(ew, aw):
+            fx, fy = number(x), number(y)
+            if fx is None or fy is None:
+                if x != y:
+                    problems.append("line %d: '%s', expected '%s'" % (n, y, x))
+            elif abs(fx - fy) > tol:
+                problems.append("line %d: %s, expected %s" % (n, y, x))
+            else:
+                worst = max(worst, abs(fx - fy))
+        if len(problems) >= 10:
+            break
+    return problems, worst
+
+if __name__=="__main__":
+    parser = argparse.ArgumentParser(description="Golden-vector comparison")
+    parser.add_argument("--input", required=True, help="recording for PICO_SIM_ADC_INPUT")
+    parser.add_argument("--expected", required=True, help="reference output")
+    parser.add_argument("--tol", type=float, default=0, help="largest difference allowed in any number")
+    parser.add_argument("--stdin", help="file to feed the program as serial input")
+    parser.add_argument("--frames", action="store_true", help="decode binary spectrum frames")
+    parser.add_argument("--update", action="store_true", help="write the output as the reference")
+    parser.add_argument("command", nargs="+", help="program and its arguments")
+    args = parser.parse_args()
+
+    env = dict(os.environ, PICO_SIM_ADC_INPUT=args.input)
+    stdin = open(args.stdin, "rb") if args.stdin else subprocess.DEVNULL
+    run = subprocess.run(args.command, env=env, stdin=stdin,
+                         stdout=subprocess.PIPE, stderr=subprocess.PIPE, timeout=60)
+    if run.returncode != 0:
+        sys.stderr.write(run.stderr.decode(errors="replace"))
+        sys.exit("%s exited with %d" % (args.command[0], run.returncode))
+
+    actual = decode_frames(run.stdout) if args.frames else run.stdout.decode()
+    if args.update:
+        with open(args.expected, "w") as f:
+            f.write(actual)
+        print("wrote %s" % args.expected)
+        sys.exit(0)
+
+    with open(args.expected) as f:
+        expected = f.read()
+    problems, worst = compare(expected, actual, args.tol)
+    for p in problems:
+        print(p)
+    if problems:
+        sys.exit("%s differs from %s (tolerance %g)" % (args.command[0], args.expected, args.tol))
+    print("%d lines match %s, largest difference %g (tolerance %g)" %
+          (len(expected.splitlines()), args.expected, worst, args.tol))
@@ -0,0 +1,51 @@
+import math
+import random
+import struct
+import wave
+
+# Writes the golden-vector input recordings. They are checked in, so this
+# only needs running again to change them, after which the references
+# have to be regenerated (see README.md).
+#
+# The simulated ADC takes one sample per conversion whatever the file's
+# rate, so the rates here are only the ones the programs sample at.
+
+def write_wav(name, rate, samples):
+    with wave.open(name, "wb") as w:
+        w.setnchannels(1)
+        w.setsampwidth(2)
+        w.setframerate(rate)
+        w.writeframes(b"".join(struct.pack("<h", max(-32768, min(32767, round(s * 32767))))
+                               for s in samples))
+
+if __name__=="__main__":
+    rng = random.Random(1234)
+
+    # adc_fft: eight blocks of 1000 samples at 50 kHz, each with its own
+    # tones, most of them between FFT bins, over a little noise
+    rate = 50000
+    blocks = [(440,), (1230, 7010), (3333,), (5100, 5150), (9876,),
+              (12500, 300), (18020,), (23456,)]
+    samples = []
+    for n, tones in enumerate(blocks):
+        for i in range(1000):
+            t = (n * 1000 + i) / rate
+            s = sum(0.5 / (k + 1) * math.sin(2 * math.pi * f * t)
+                    for k, f in enumerate(tones))
+            samples.append(s + rng.gauss(0, 0.003))
+    write_wav("tones.wav", rate, samples)
+
+    # pico-light-voice: 1.25 s at 4 kHz of something voice-like, a gliding
+    # harmonic series under a syllable envelope, with a burst of noise
+    rate = 4000
+    samples = []
+    phase = 0
+    for i in range(5000):
+        t = i / rate
+        f0 = 120 + 80 * t
+        phase += 2 * math.pi * f0 / rate
+        env = 0.2 + 0.8 * math.sin(math.pi * t / 0.75) ** 2
+        s = sum(math.sin(k * phase) / k for k in range(1, 12) if k * f0 < rate / 2)
+        noise = rng.gauss(0, 0.15) if 0.9 < t < 1.1 else rng.gauss(0, 0.005)
+        samples.append(0.3 * env * s + noise)
+    write_wav("voice.wav", rate, samples)
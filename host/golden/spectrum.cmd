@@ -0,0 +1 @@
+bits 16
@@ -0,0 +1,44 @@
+// Runs the lighting core (lights.cpp) on its own, in place of main.cpp's
+// keyword spotting loop. Each line on stdin is an event for core 1:
+//
+//   start      the "on/next state" keyword
+//   stop       the "off" keyword
+//   wait <ms>  let the lights run for a while (in real time)
+//
+// With PICO_SIM_PIO_OUTPUT set, every frame sent to the strip is recorded.
+
+#include <pico/multicore.h>
+#include <pico/stdlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lights.h"
+
+int main() {
+  stdio_init_all();
+  multicore_launch_core1(core1_entry);
+
+  char line[64];
+  while (fgets(line, sizeof(line), stdin)) {
+    uint32_t event = 0;
+    if (strncmp(line, "start", 5) == 0) {
+      event = 1;
+    } else if (strncmp(line, "stop", 4) == 0) {
+      event = 2;
+    } else if (strncmp(line, "wait", 4) == 0) {
+      uint64_t end = time_us_64() + strtoul(line + 4, NULL, 10) * 1000ull;
+      while (time_us_64() < end) __wfe();
+      continue;
+    } else {
+      continue;
+    }
+
+    // same handshake as main.cpp: core 1 asks for each update
+    multicore_fifo_pop_blocking();
+    multicore_fifo_push_blocking(event);
+  }
+
+  // let core 1 act on the last event before exiting
+  multicore_fifo_pop_blocking();
+  return 0;
+}
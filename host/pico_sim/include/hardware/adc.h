@@ -0,0 +1,58 @@
+#pragma once
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The simulated ADC converts samples from the file named by the
+// PICO_SIM_ADC_INPUT environment variable: a WAV file (8/16-bit PCM or
+// 32-bit float, first channel) or a CSV/text file whose first column holds
+// raw 12-bit codes. Each conversion that is read takes the next sample, and
+// the program exits once the file runs out. Without a file the input is a
+// 1 kHz sine around mid-scale.
+
+// Register block; its FIFO address is what DMA channels read from
+typedef struct {
+  volatile uint32_t cs;
+  volatile uint32_t result;
+  volatile uint32_t fcs;
+  volatile uint32_t fifo;
+  volatile uint32_t div;
+  volatile uint32_t intr;
+  volatile uint32_t inte;
+  volatile uint32_t intf;
+  volatile uint32_t ints;
+} adc_hw_t;
+
+extern adc_hw_t *const adc_hw;
+
+#define ADC_TEMPERATURE_CHANNEL_NUM 4
+
+void adc_init(void);
+void adc_gpio_init(uint gpio);
+void adc_select_input(uint input);
+uint adc_get_selected_input(void);
+void adc_set_round_robin(uint input_mask);
+void adc_set_temp_sensor_enabled(bool enable);
+
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh,
+                    bool err_in_fifo, bool byte_shift);
+
+// Conversions take 96 ADC clocks, or 1 + clkdiv clocks if that is longer
+void adc_set_clkdiv(float clkdiv);
+void adc_run(bool run);
+
+// Single blocking conversion, always 12 bits
+uint16_t adc_read(void);
+
+bool adc_fifo_is_empty(void);
+uint8_t adc_fifo_get_level(void);
+uint16_t adc_fifo_get(void);
+uint16_t adc_fifo_get_blocking(void);
+void adc_fifo_drain(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum clock_index {
+  clk_gpout0 = 0,
+  clk_gpout1,
+  clk_gpout2,
+  clk_gpout3,
+  clk_ref,
+  clk_sys,
+  clk_peri,
+  clk_usb,
+  clk_adc,
+  clk_rtc,
+  CLK_COUNT
+};
+
+#define KHZ 1000
+#define MHZ 1000000
+
+// auxsrc values used with clock_configure()
+#define CLOCKS_CLK_ADC_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB 0x0
+#define CLOCKS_CLK_PERI_CTRL_AUXSRC_VALUE_CLK_SYS 0x0
+
+// Default frequencies: 125 MHz system clock, 48 MHz USB and ADC clocks
+uint32_t clock_get_hz(enum clock_index clk_index);
+
+// Only the frequency is simulated; the sources are taken on trust
+bool clock_configure(enum clock_index clk_index, uint32_t src, uint32_t auxsrc,
+                     uint32_t src_freq, uint32_t freq);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "pico.h"
+#include "hardware/sync.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Simulated DMA. Transfers are paced by their DREQ: from the ADC FIFO at
+// the ADC conversion rate, into a PIO TX FIFO at the rate the state machine
+// shifts data out, and unpaced (memory to memory) immediately. A transfer's
+// data moves when it completes on the virtual clock, which is also when its
+// channel raises DMA_IRQ_0/1 and triggers its chain_to channel.
+//
+// Channels are driven through the functions below; the register block only
+// mirrors their state, apart from INTS0/INTS1 which the IRQ handlers read.
+
+#define NUM_DMA_CHANNELS 12
+
+#define DREQ_PIO0_TX0 0
+#define DREQ_PIO0_RX0 4
+#define DREQ_PIO1_TX0 8
+#define DREQ_PIO1_RX0 12
+#define DREQ_ADC 36
+#define DREQ_FORCE 63
+
+enum dma_channel_transfer_size {
+  DMA_SIZE_8 = 0,
+  DMA_SIZE_16 = 1,
+  DMA_SIZE_32 = 2
+};
+
+// CTRL register layout, as on the RP2040
+#define DMA_CH0_CTRL_TRIG_EN_BITS 0x00000001u
+#define DMA_CH0_CTRL_TRIG_HIGH_PRIORITY_BITS 0x00000002u
+#define DMA_CH0_CTRL_TRIG_DATA_SIZE_LSB 2
+#define DMA_CH0_CTRL_TRIG_DATA_SIZE_BITS 0x0000000cu
+#define DMA_CH0_CTRL_TRIG_INCR_READ_BITS 0x00000010u
+#define DMA_CH0_CTRL_TRIG_INCR_WRITE_BITS 0x00000020u
+#define DMA_CH0_CTRL_TRIG_RING_SIZE_LSB 6
+#define DMA_CH0_CTRL_TRIG_RING_SIZE_BITS 0x000003c0u
+#define DMA_CH0_CTRL_TRIG_RING_SEL_BITS 0x00000400u
+#define DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB 11
+#define DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS 0x00007800u
+#define DMA_CH0_CTRL_TRIG_TREQ_SEL_LSB 15
+#define DMA_CH0_CTRL_TRIG_TREQ_SEL_BITS 0x001f8000u
+#define DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS 0x00200000u
+#define DMA_CH0_CTRL_TRIG_BSWAP_BITS 0x00400000u
+#define DMA_CH0_CTRL_TRIG_BUSY_BITS 0x01000000u
+
+typedef struct {
+  volatile uintptr_t read_addr;
+  volatile uintptr_t write_addr;
+  volatile uint32_t transfer_count;
+  volatile uint32_t ctrl_trig;
+} dma_channel_hw_t;
+
+typedef struct {
+  dma_channel_hw_t ch[NUM_DMA_CHANNELS];
+  volatile uint32_t intr;
+  volatile uint32_t inte0;
+  volatile uint32_t intf0;
+  volatile uint32_t ints0;
+  volatile uint32_t inte1;
+  volatile uint32_t intf1;
+  volatile uint32_t ints1;
+} dma_hw_t;
+
+extern dma_hw_t *const dma_hw;
+
+typedef struct {
+  uint32_t ctrl;
+} dma_channel_config;
+
+static inline void channel_config_set_read_increment(dma_channel_config *c, bool incr) {
+  c->ctrl = incr ? (c->ctrl | DMA_CH0_CTRL_TRIG_INCR_READ_BITS)
+                 : (c->ctrl & ~DMA_CH0_CTRL_TRIG_INCR_READ_BITS);
+}
+
+static inline void channel_config_set_write_increment(dma_channel_config *c, bool incr) {
+  c->ctrl = incr ? (c->ctrl | DMA_CH0_CTRL_TRIG_INCR_WRITE_BITS)
+                 : (c->ctrl & ~DMA_CH0_CTRL_TRIG_INCR_WRITE_BITS);
+}
+
+static inline void channel_config_set_dreq(dma_channel_config *c, uint dreq) {
+  c->ctrl = (c->ctrl & ~DMA_CH0_CTRL_TRIG_TREQ_SEL_BITS) |
+            (dreq << DMA_CH0_CTRL_TRIG_TREQ_SEL_LSB);
+}
+
+static inline void channel_config_set_chain_to(dma_channel_config *c, uint chain_to) {
+  c->ctrl = (c->ctrl & ~DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS) |
+            (chain_to << DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB);
+}
+
+static inline void channel_config_set_transfer_data_size(dma_channel_config *c,
+                                                         enum dma_channel_transfer_size size) {
+  c->ctrl = (c->ctrl & ~DMA_CH0_CTRL_TRIG_DATA_SIZE_BITS) |
+            ((uint)size << DMA_CH0_CTRL_TRIG_DATA_SIZE_LSB);
+}
+
+static inline void channel_config_set_ring(dma_channel_config *c, bool write, uint size_bits) {
+  c->ctrl = (c->ctrl & ~(DMA_CH0_CTRL_TRIG_RING_SIZE_BITS | DMA_CH0_CTRL_TRIG_RING_SEL_BITS)) |
+            (size_bits << DMA_CH0_CTRL_TRIG_RING_SIZE_LSB) |
+            (write ? DMA_CH0_CTRL_TRIG_RING_SEL_BITS : 0);
+}
+
+static inline void channel_config_set_bswap(dma_channel_config *c, bool bswap) {
+  c->ctrl = bswap ? (c->ctrl | DMA_CH0_CTRL_TRIG_BSWAP_BITS)
+                  : (c->ctrl & ~DMA_CH0_CTRL_TRIG_BSWAP_BITS);
+}
+
+static inline void channel_config_set_irq_quiet(dma_channel_config *c, bool irq_quiet) {
+  c->ctrl = irq_quiet ? (c->ctrl | DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS)
+                      : (c->ctrl & ~DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS);
+}
+
+static inline void channel_config_set_enable(dma_channel_config *c, bool enable) {
+  c->ctrl = enable ? (c->ctrl | DMA_CH0_CTRL_TRIG_EN_BITS)
+                   : (c->ctrl & ~DMA_CH0_CTRL_TRIG_EN_BITS);
+}
+
+// Enabled, 32-bit, read increment, unpaced, chained to itself (no chain)
+static inline dma_channel_config dma_channel_get_default_config(uint channel) {
+  dma_channel_config c = {0};
+  channel_config_set_read_increment(&c, true);
+  channel_config_set_write_increment(&c, false);
+  channel_config_set_dreq(&c, DREQ_FORCE);
+  channel_config_set_chain_to(&c, channel);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+  channel_config_set_ring(&c, false, 0);
+  channel_config_set_bswap(&c, false);
+  channel_config_set_irq_quiet(&c, false);
+  channel_config_set_enable(&c, true);
+  return c;
+}
+
+static inline uint32_t channel_config_get_ctrl_value(const dma_channel_config *c) {
+  return c->ctrl;
+}
+
+void dma_channel_claim(uint channel);
+int dma_claim_unused_channel(bool required);
+void dma_channel_unclaim(uint channel);
+bool dma_channel_is_claimed(uint channel);
+
+void dma_channel_set_config(uint channel, const dma_channel_config *config, bool trigger);
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger);
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger);
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger);
+
+void dma_channel_configure(uint channel, const dma_channel_config *config,
+                           volatile void *write_addr, const volatile void *read_addr,
+                           uint transfer_count, bool trigger);
+
+void dma_channel_transfer_from_buffer_now(uint channel, const volatile void *read_addr,
+                                          uint32_t transfer_count);
+void dma_channel_transfer_to_buffer_now(uint channel, volatile void *write_addr,
+                                        uint32_t transfer_count);
+
+void dma_start_channel_mask(uint32_t chan_mask);
+static inline void dma_channel_start(uint channel) { dma_start_channel_mask(1u << channel); }
+void dma_channel_abort(uint channel);
+
+bool dma_channel_is_busy(uint channel);
+void dma_channel_wait_for_finish_blocking(uint channel);
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled);
+void dma_channel_set_irq1_enabled(uint channel, bool enabled);
+
+static inline void dma_channel_acknowledge_irq0(uint channel) { dma_hw->ints0 &= ~(1u << channel); }
+static inline void dma_channel_acknowledge_irq1(uint channel) { dma_hw->ints1 &= ~(1u << channel); }
+
+#ifdef __cplusplus
+}
+#endif
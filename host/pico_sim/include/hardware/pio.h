@@ -0,0 +1,169 @@
+#pragma once
+
+#include "pico.h"
+#include "hardware/dma.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Simulated PIO. Programs are not executed: a state machine takes words
+// from its TX FIFO and shifts them out of the OSR using its configured shift
+// direction, pull threshold and the width of its program's first `out`
+// instruction. Each `out` takes PIO_SIM_CYCLES_PER_OUT state machine cycles,
+// the WS2812 bit time the programs in this repository are written for.
+//
+// If PICO_SIM_PIO_OUTPUT names a file, every burst of data a state machine
+// sends without going idle is appended to it as one line:
+//     <start time us> pio<n> sm<n> <number of bits> <bits as hex, MSB first>
+
+#define NUM_PIOS 2
+#define NUM_PIO_STATE_MACHINES 4
+#define PIO_INSTRUCTION_COUNT 32
+#define PIO_SIM_CYCLES_PER_OUT 10
+
+typedef struct {
+  volatile uint32_t ctrl;
+  volatile uint32_t fstat;
+  volatile uint32_t fdebug;
+  volatile uint32_t flevel;
+  volatile uint32_t txf[NUM_PIO_STATE_MACHINES];
+  volatile uint32_t rxf[NUM_PIO_STATE_MACHINES];
+} pio_hw_t;
+
+typedef pio_hw_t *PIO;
+
+extern pio_hw_t *const pio0;
+extern pio_hw_t *const pio1;
+
+// Generated by pico_generate_pio_header(); instructions are not assembled,
+// only counted, and out_bits is taken from the first `out` instruction
+typedef struct pio_program {
+  const uint16_t *instructions;
+  uint8_t length;
+  int8_t origin;
+  uint8_t out_bits;
+} pio_program_t;
+
+typedef struct {
+  uint32_t clkdiv;
+  uint32_t execctrl;
+  uint32_t shiftctrl;
+  uint32_t pinctrl;
+} pio_sm_config;
+
+enum pio_fifo_join {
+  PIO_FIFO_JOIN_NONE = 0,
+  PIO_FIFO_JOIN_TX = 1,
+  PIO_FIFO_JOIN_RX = 2,
+};
+
+// Register fields, as on the RP2040
+#define PIO_SM0_CLKDIV_INT_LSB 16
+#define PIO_SM0_CLKDIV_FRAC_LSB 8
+#define PIO_SM0_EXECCTRL_WRAP_TOP_LSB 12
+#define PIO_SM0_EXECCTRL_WRAP_BOTTOM_LSB 7
+#define PIO_SM0_EXECCTRL_SIDE_EN_BITS 0x40000000u
+#define PIO_SM0_EXECCTRL_SIDE_PINDIR_BITS 0x20000000u
+#define PIO_SM0_SHIFTCTRL_AUTOPULL_BITS 0x00020000u
+#define PIO_SM0_SHIFTCTRL_OUT_SHIFTDIR_BITS 0x00080000u
+#define PIO_SM0_SHIFTCTRL_PULL_THRESH_LSB 25
+#define PIO_SM0_SHIFTCTRL_PULL_THRESH_BITS 0x3e000000u
+#define PIO_SM0_SHIFTCTRL_FJOIN_TX_BITS 0x40000000u
+#define PIO_SM0_SHIFTCTRL_FJOIN_RX_BITS 0x80000000u
+#define PIO_SM0_PINCTRL_OUT_BASE_LSB 0
+#define PIO_SM0_PINCTRL_OUT_COUNT_LSB 20
+#define PIO_SM0_PINCTRL_SIDESET_BASE_LSB 10
+#define PIO_SM0_PINCTRL_SIDESET_COUNT_LSB 29
+
+static inline void sm_config_set_out_pins(pio_sm_config *c, uint out_base, uint out_count) {
+  c->pinctrl = (c->pinctrl & ~(0x1fu << PIO_SM0_PINCTRL_OUT_BASE_LSB) & ~(0x3fu << PIO_SM0_PINCTRL_OUT_COUNT_LSB)) |
+               (out_base << PIO_SM0_PINCTRL_OUT_BASE_LSB) |
+               (out_count << PIO_SM0_PINCTRL_OUT_COUNT_LSB);
+}
+
+static inline void sm_config_set_sideset_pins(pio_sm_config *c, uint sideset_base) {
+  c->pinctrl = (c->pinctrl & ~(0x1fu << PIO_SM0_PINCTRL_SIDESET_BASE_LSB)) |
+               (sideset_base << PIO_SM0_PINCTRL_SIDESET_BASE_LSB);
+}
+
+static inline void sm_config_set_sideset(pio_sm_config *c, uint bit_count, bool optional, bool pindirs) {
+  c->pinctrl = (c->pinctrl & ~(0x7u << PIO_SM0_PINCTRL_SIDESET_COUNT_LSB)) |
+               (bit_count << PIO_SM0_PINCTRL_SIDESET_COUNT_LSB);
+  c->execctrl = (c->execctrl & ~(PIO_SM0_EXECCTRL_SIDE_EN_BITS | PIO_SM0_EXECCTRL_SIDE_PINDIR_BITS)) |
+                (optional ? PIO_SM0_EXECCTRL_SIDE_EN_BITS : 0) |
+                (pindirs ? PIO_SM0_EXECCTRL_SIDE_PINDIR_BITS : 0);
+}
+
+static inline void sm_config_set_clkdiv_int_frac(pio_sm_config *c, uint16_t div_int, uint8_t div_frac) {
+  c->clkdiv = ((uint32_t)div_frac << PIO_SM0_CLKDIV_FRAC_LSB) |
+              ((uint32_t)div_int << PIO_SM0_CLKDIV_INT_LSB);
+}
+
+static inline void sm_config_set_clkdiv(pio_sm_config *c, float div) {
+  uint16_t div_int = (uint16_t)div;
+  uint8_t div_frac = div_int ? (uint8_t)((div - (float)div_int) * 256) : 0;
+  sm_config_set_clkdiv_int_frac(c, div_int, div_frac);
+}
+
+static inline void sm_config_set_wrap(pio_sm_config *c, uint wrap_target, uint wrap) {
+  c->execctrl = (c->execctrl & ~((0x1fu << PIO_SM0_EXECCTRL_WRAP_TOP_LSB) | (0x1fu << PIO_SM0_EXECCTRL_WRAP_BOTTOM_LSB))) |
+                (wrap_target << PIO_SM0_EXECCTRL_WRAP_BOTTOM_LSB) |
+                (wrap << PIO_SM0_EXECCTRL_WRAP_TOP_LSB);
+}
+
+// A threshold of 32 is stored as 0, as in the hardware
+static inline void sm_config_set_out_shift(pio_sm_config *c, bool shift_right, bool autopull, uint pull_threshold) {
+  c->shiftctrl = (c->shiftctrl & ~(PIO_SM0_SHIFTCTRL_OUT_SHIFTDIR_BITS | PIO_SM0_SHIFTCTRL_AUTOPULL_BITS | PIO_SM0_SHIFTCTRL_PULL_THRESH_BITS)) |
+                 (shift_right ? PIO_SM0_SHIFTCTRL_OUT_SHIFTDIR_BITS : 0) |
+                 (autopull ? PIO_SM0_SHIFTCTRL_AUTOPULL_BITS : 0) |
+                 ((pull_threshold & 0x1fu) << PIO_SM0_SHIFTCTRL_PULL_THRESH_LSB);
+}
+
+static inline void sm_config_set_fifo_join(pio_sm_config *c, enum pio_fifo_join join) {
+  c->shiftctrl = (c->shiftctrl & ~(PIO_SM0_SHIFTCTRL_FJOIN_TX_BITS | PIO_SM0_SHIFTCTRL_FJOIN_RX_BITS)) |
+                 (join == PIO_FIFO_JOIN_TX ? PIO_SM0_SHIFTCTRL_FJOIN_TX_BITS : 0) |
+                 (join == PIO_FIFO_JOIN_RX ? PIO_SM0_SHIFTCTRL_FJOIN_RX_BITS : 0);
+}
+
+static inline pio_sm_config pio_get_default_sm_config(void) {
+  pio_sm_config c = {0, 0, 0, 0};
+  sm_config_set_clkdiv_int_frac(&c, 1, 0);
+  sm_config_set_wrap(&c, 0, 31);
+  sm_config_set_out_shift(&c, true, false, 32);
+  return c;
+}
+
+static inline uint pio_get_index(PIO pio) { return pio == pio1 ? 1 : 0; }
+
+static inline uint pio_get_dreq(PIO pio, uint sm, bool is_tx) {
+  return (pio == pio1 ? DREQ_PIO1_TX0 : DREQ_PIO0_TX0) + sm + (is_tx ? 0 : 4);
+}
+
+bool pio_can_add_program(PIO pio, const pio_program_t *program);
+uint pio_add_program(PIO pio, const pio_program_t *program);
+void pio_remove_program(PIO pio, const pio_program_t *program, uint loaded_offset);
+
+void pio_sm_claim(PIO pio, uint sm);
+int pio_claim_unused_sm(PIO pio, bool required);
+void pio_sm_unclaim(PIO pio, uint sm);
+
+void pio_gpio_init(PIO pio, uint pin);
+int pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out);
+
+void pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config);
+void pio_sm_set_config(PIO pio, uint sm, const pio_sm_config *config);
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled);
+void pio_sm_set_clkdiv(PIO pio, uint sm, float div);
+void pio_sm_set_clkdiv_int_frac(PIO pio, uint sm, uint16_t div_int, uint8_t div_frac);
+
+void pio_sm_put(PIO pio, uint sm, uint32_t data);
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data);
+bool pio_sm_is_tx_fifo_empty(PIO pio, uint sm);
+bool pio_sm_is_tx_fifo_full(PIO pio, uint sm);
+uint pio_sm_get_tx_fifo_level(PIO pio, uint sm);
+void pio_sm_clear_fifos(PIO pio, uint sm);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Each core has an event flag and __sev() sets both, as on the RP2040.
+// __wfe() may also return spuriously, after a millisecond of real time.
+void __wfe(void);
+void __sev(void);
+
+static inline void __wfi(void) { __wfe(); }
+static inline void __dmb(void) { __sync_synchronize(); }
+static inline void __dsb(void) { __sync_synchronize(); }
+static inline void __isb(void) { __sync_synchronize(); }
+
+// Simulated interrupt handlers run on their own thread, so masking them
+// takes a lock shared with that thread rather than a PRIMASK bit
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint64_t time_us_64(void);
+
+static inline uint32_t time_us_32(void) { return (uint32_t)time_us_64(); }
+
+// Spins in real time, like the CPU would
+void busy_wait_us(uint64_t delay_us);
+
+#ifdef __cplusplus
+}
+#endif
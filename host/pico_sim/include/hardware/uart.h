@@ -0,0 +1,6 @@
+#pragma once
+
+#include "pico.h"
+
+// Only here so programs that include it build; stdio goes to the host
+typedef struct uart_inst uart_inst_t;
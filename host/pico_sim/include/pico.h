@@ -0,0 +1,12 @@
+// Host stand-in for the pico-sdk's top level header. Everything under this
+// include directory mirrors the part of the SDK API the programs in this
+// repository use, backed by the simulator in ../src.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "pico/types.h"
+#include "pico/platform.h"
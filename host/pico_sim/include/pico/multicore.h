@@ -0,0 +1,24 @@
+#pragma once
+
+#include "pico.h"
+#include "hardware/sync.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Core 1 is a host thread, and the inter-core FIFOs are 8-deep queues
+// between the two threads
+
+void multicore_launch_core1(void (*entry)(void));
+
+bool multicore_fifo_rvalid(void);
+bool multicore_fifo_wready(void);
+void multicore_fifo_push_blocking(uint32_t data);
+uint32_t multicore_fifo_pop_blocking(void);
+bool multicore_fifo_pop_timeout_us(uint64_t timeout_us, uint32_t *out);
+void multicore_fifo_drain(void);
+
+#ifdef __cplusplus
+}
+#endif
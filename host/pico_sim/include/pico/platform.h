@@ -0,0 +1,24 @@
+#pragma once
+
+#include "pico/types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Code placement has no meaning on the host
+#define __not_in_flash(group)
+#define __not_in_flash_func(func_name) func_name
+#define __time_critical_func(func_name) func_name
+#define __no_inline_not_in_flash_func(func_name) func_name
+#define __isr
+
+// 0 on the thread running main(), 1 on the thread started by
+// multicore_launch_core1()
+uint get_core_num(void);
+
+static inline void tight_loop_contents(void) {}
+
+#ifdef __cplusplus
+}
+#endif
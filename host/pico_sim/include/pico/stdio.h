@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdio.h>
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define PICO_ERROR_TIMEOUT (-1)
+
+// stdout is the host's stdout and stdin reads the host's stdin
+bool stdio_init_all(void);
+void stdio_flush(void);
+
+// Returns the next character from stdin, or PICO_ERROR_TIMEOUT if none
+// arrives within timeout_us (real time)
+int getchar_timeout_us(uint32_t timeout_us);
+
+int putchar_raw(int c);
+int puts_raw(const char *s);
+
+#ifdef __cplusplus
+}
+#endif
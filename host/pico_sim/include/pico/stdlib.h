@@ -0,0 +1,24 @@
+#pragma once
+
+#include "pico.h"
+#include "pico/stdio.h"
+#include "pico/time.h"
+#include "hardware/gpio.h"
+#include "hardware/uart.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// The system PLL's settings for a clk_sys of freq_khz from the 12 MHz
+// crystal, as the SDK searches for them. false if it can't be made exactly.
+bool check_sys_clock_khz(uint32_t freq_khz, uint *vco_freq_out,
+                         uint *post_div1_out, uint *post_div2_out);
+
+// Moves clk_sys, and clk_peri with it, as the SDK does. PIO timing follows
+// the new frequency; the ADC and timer don't.
+bool set_sys_clock_khz(uint32_t freq_khz, bool required);
+
+#ifdef __cplusplus
+}
+#endif
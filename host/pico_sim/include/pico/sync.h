@@ -0,0 +1,26 @@
+#pragma once
+
+#include <pthread.h>
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Mutexes between the cores are host mutexes between their threads
+
+typedef struct {
+  pthread_mutex_t m;
+} mutex_t;
+
+static inline void mutex_init(mutex_t *mtx) { pthread_mutex_init(&mtx->m, NULL); }
+static inline void mutex_enter_blocking(mutex_t *mtx) { pthread_mutex_lock(&mtx->m); }
+static inline bool mutex_try_enter(mutex_t *mtx, uint32_t *owner_out) {
+  return pthread_mutex_trylock(&mtx->m) == 0;
+}
+static inline void mutex_exit(mutex_t *mtx) { pthread_mutex_unlock(&mtx->m); }
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "pico.h"
+#include "hardware/timer.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Time runs on a virtual clock: it follows the host's monotonic clock, but
+// sleeps and blocking waits on simulated hardware jump it forward instead of
+// waiting, so programs run as fast as the host can compute.
+
+extern const absolute_time_t at_the_end_of_time;
+extern const absolute_time_t nil_time;
+
+static inline uint64_t to_us_since_boot(absolute_time_t t) { return t; }
+static inline uint32_t to_ms_since_boot(absolute_time_t t) { return (uint32_t)(t / 1000); }
+static inline absolute_time_t from_us_since_boot(uint64_t us) { return us; }
+
+static inline absolute_time_t get_absolute_time(void) { return time_us_64(); }
+
+static inline absolute_time_t delayed_by_us(absolute_time_t t, uint64_t us) {
+  return (t + us < t) ? at_the_end_of_time : t + us;
+}
+static inline absolute_time_t delayed_by_ms(absolute_time_t t, uint32_t ms) {
+  return delayed_by_us(t, ms * 1000ull);
+}
+static inline absolute_time_t make_timeout_time_us(uint64_t us) {
+  return delayed_by_us(get_absolute_time(), us);
+}
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms) {
+  return delayed_by_ms(get_absolute_time(), ms);
+}
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) {
+  return (int64_t)(to - from);
+}
+static inline bool is_at_the_end_of_time(absolute_time_t t) {
+  return t == at_the_end_of_time;
+}
+
+void sleep_until(absolute_time_t target);
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+
+// Alarms and repeating timers. Callbacks run on the simulator's event
+// thread, which stands in for the timer IRQ.
+
+typedef int32_t alarm_id_t;
+typedef int64_t (*alarm_callback_t)(alarm_id_t id, void *user_data);
+
+typedef struct alarm_pool alarm_pool_t;
+
+typedef struct repeating_timer repeating_timer_t;
+typedef bool (*repeating_timer_callback_t)(repeating_timer_t *rt);
+
+struct repeating_timer {
+  int64_t delay_us;
+  alarm_pool_t *pool;
+  alarm_id_t alarm_id;
+  repeating_timer_callback_t callback;
+  void *user_data;
+};
+
+alarm_pool_t *alarm_pool_get_default(void);
+alarm_pool_t *alarm_pool_create(uint hardware_alarm_num, uint max_timers);
+
+alarm_id_t alarm_pool_add_alarm_in_us(alarm_pool_t *pool, uint64_t us,
+                                      alarm_callback_t callback,
+                                      void *user_data, bool fire_if_past);
+bool alarm_pool_cancel_alarm(alarm_pool_t *pool, alarm_id_t alarm_id);
+
+static inline alarm_id_t add_alarm_in_us(uint64_t us, alarm_callback_t callback,
+                                         void *user_data, bool fire_if_past) {
+  return alarm_pool_add_alarm_in_us(alarm_pool_get_default(), us, callback,
+                                    user_data, fire_if_past);
+}
+static inline alarm_id_t add_alarm_in_ms(uint32_t ms, alarm_callback_t callback,
+                                         void *user_data, bool fire_if_past) {
+  return add_alarm_in_us(ms * 1000ull, callback, user_data, fire_if_past);
+}
+static inline bool cancel_alarm(alarm_id_t alarm_id) {
+  return alarm_pool_cancel_alarm(alarm_pool_get_default(), alarm_id);
+}
+
+// A negative delay_us is measured start-to-start, a positive one from the
+// end of one callback to the start of the next
+bool alarm_pool_add_repeating_timer_us(alarm_pool_t *pool, int64_t delay_us,
+                                       repeating_timer_callback_t callback,
+                                       void *user_data, repeating_timer_t *out);
+bool cancel_repeating_timer(repeating_timer_t *timer);
+
+static inline bool add_repeating_timer_us(int64_t delay_us,
+                                          repeating_timer_callback_t callback,
+                                          void *user_data, repeating_timer_t *out) {
+  return alarm_pool_add_repeating_timer_us(alarm_pool_get_default(), delay_us,
+                                           callback, user_data, out);
+}
+static inline bool add_repeating_timer_ms(int32_t delay_ms,
+                                          repeating_timer_callback_t callback,
+                                          void *user_data, repeating_timer_t *out) {
+  return add_repeating_timer_us(delay_ms * (int64_t)1000, callback, user_data, out);
+}
+
+#ifdef __cplusplus
+}
+#endif
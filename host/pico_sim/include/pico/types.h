@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef unsigned int uint;
+
+// Microseconds since boot on the simulator's virtual clock
+typedef uint64_t absolute_time_t;
@@ -0,0 +1,142 @@
+# Writes the C header pioasm would generate for a .pio file, without
+# assembling it: the program's instructions are counted (and left as zero),
+# and everything the C side uses is emitted -- public defines, wrap points,
+# side-set config, the width of the first `out` and the `% c-sdk` blocks.
+#
+# pico_sim_pio_header(<pio file> <header>)
+
+function(pico_sim_pio_header PIO HEADER)
+  file(READ ${PIO} SOURCE)
+  # keep ; out of the list handling below
+  string(REPLACE ";" "<semicolon>" SOURCE "${SOURCE}")
+  string(REPLACE "\n" ";" LINES "${SOURCE}")
+
+  set(OUT "// Generated from ${PIO} for the host simulator; do not edit\n\n#pragma once\n\n#if !PICO_NO_HARDWARE\n#include \"hardware/pio.h\"\n#endif\n")
+  set(PROGRAM "")
+  set(BLOCK "")
+
+  foreach(LINE IN LISTS LINES)
+    string(REPLACE "<semicolon>" ";" CODE_LINE "${LINE}")
+
+    if(BLOCK)
+      if(LINE MATCHES "^%}")
+        if(BLOCK STREQUAL "c-sdk")
+          string(APPEND OUT "${CSDK}#endif\n")
+        endif()
+        set(BLOCK "")
+      else()
+        string(APPEND CSDK "${CODE_LINE}\n")
+      endif()
+      continue()
+    endif()
+    if(LINE MATCHES "^% *([a-z-]+) *{")
+      # the program's own definitions come before code that uses them
+      if(PROGRAM)
+        _pico_sim_pio_program(OUT)
+        set(PROGRAM "")
+      endif()
+      set(BLOCK ${CMAKE_MATCH_1})
+      set(CSDK "\n#if !PICO_NO_HARDWARE\n")
+      continue()
+    endif()
+
+    string(REGEX REPLACE "<semicolon>.*" "" CODE "${LINE}")
+    string(REGEX REPLACE "//.*" "" CODE "${CODE}")
+    string(STRIP "${CODE}" CODE)
+    if(CODE STREQUAL "")
+      continue()
+    endif()
+
+    if(CODE MATCHES "^\\.program +([A-Za-z_][A-Za-z0-9_]*)")
+      if(PROGRAM)
+        _pico_sim_pio_program(OUT)
+      endif()
+      set(PROGRAM ${CMAKE_MATCH_1})
+      set(LENGTH 0)
+      set(WRAP_TARGET 0)
+      set(WRAP "")
+      set(ORIGIN -1)
+      set(OUT_BITS 0)
+      set(SIDE_SET "")
+      set(DEFINES "")
+    elseif(CODE MATCHES "^\\.define +(PUBLIC +|public +)?([A-Za-z_][A-Za-z0-9_]*) +(.+)$")
+      set(DEF_${CMAKE_MATCH_2} ${CMAKE_MATCH_3})
+      if(CMAKE_MATCH_1)
+        if(PROGRAM)
+          string(APPEND DEFINES "#define ${PROGRAM}_${CMAKE_MATCH_2} ${CMAKE_MATCH_3}\n")
+        else()
+          string(APPEND OUT "#define ${CMAKE_MATCH_2} ${CMAKE_MATCH_3}\n")
+        endif()
+      endif()
+    elseif(CODE MATCHES "^\\.side_set +([0-9]+)( +opt)?( +pindirs)?")
+      set(SIDE_SET ${CMAKE_MATCH_1})
+      set(SIDE_OPT false)
+      set(SIDE_PINDIRS false)
+      if(CMAKE_MATCH_2)
+        set(SIDE_OPT true)
+        math(EXPR SIDE_SET "${SIDE_SET} + 1")
+      endif()
+      if(CMAKE_MATCH_3)
+        set(SIDE_PINDIRS true)
+      endif()
+    elseif(CODE MATCHES "^\\.origin +([0-9]+)")
+      set(ORIGIN ${CMAKE_MATCH_1})
+    elseif(CODE STREQUAL ".wrap_target")
+      set(WRAP_TARGET ${LENGTH})
+    elseif(CODE STREQUAL ".wrap")
+      math(EXPR WRAP "${LENGTH} - 1")
+    elseif(CODE MATCHES "^\\.word")
+      math(EXPR LENGTH "${LENGTH} + 1")
+    elseif(CODE MATCHES "^\\.")
+      # .lang_opt and friends don't affect the C side
+    else()
+      # an instruction, possibly after a label
+      string(REGEX REPLACE "^(public +)?[A-Za-z_][A-Za-z0-9_]*:" "" CODE "${CODE}")
+      string(STRIP "${CODE}" CODE)
+      if(NOT CODE STREQUAL "")
+        math(EXPR LENGTH "${LENGTH} + 1")
+        if(OUT_BITS EQUAL 0 AND CODE MATCHES "^out +[!~]?[a-z]+ *, *([A-Za-z0-9_]+)")
+          set(OUT_BITS ${CMAKE_MATCH_1})
+          if(DEFINED DEF_${OUT_BITS})
+            set(OUT_BITS ${DEF_${OUT_BITS}})
+          endif()
+        endif()
+      endif()
+    endif()
+  endforeach()
+  if(PROGRAM)
+    _pico_sim_pio_program(OUT)
+  endif()
+
+  # only touch the header when it changes, to avoid needless rebuilds
+  set(OLD "")
+  if(EXISTS ${HEADER})
+    file(READ ${HEADER} OLD)
+  endif()
+  if(NOT OLD STREQUAL OUT)
+    file(WRITE ${HEADER} "${OUT}")
+  endif()
+endfunction()
+
+# Appends the finished program in the caller's scope to the named variable
+macro(_pico_sim_pio_program VAR)
+  if(WRAP STREQUAL "")
+    math(EXPR WRAP "${LENGTH} - 1")
+  endif()
+  set(ZEROS "")
+  foreach(I RANGE 1 ${LENGTH})
+    string(APPEND ZEROS "    0x0000,\n")
+  endforeach()
+
+  string(APPEND ${VAR} "\n// ${PROGRAM}\n\n")
+  string(APPEND ${VAR} "#define ${PROGRAM}_wrap_target ${WRAP_TARGET}\n#define ${PROGRAM}_wrap ${WRAP}\n\n")
+  string(APPEND ${VAR} "${DEFINES}\n")
+  string(APPEND ${VAR} "static const uint16_t ${PROGRAM}_program_instructions[] = {\n${ZEROS}};\n\n")
+  string(APPEND ${VAR} "#if !PICO_NO_HARDWARE\n")
+  string(APPEND ${VAR} "static const struct pio_program ${PROGRAM}_program = {\n    ${PROGRAM}_program_instructions,\n    ${LENGTH},\n    ${ORIGIN},\n    ${OUT_BITS},\n};\n\n")
+  string(APPEND ${VAR} "static inline pio_sm_config ${PROGRAM}_program_get_default_config(uint offset) {\n    pio_sm_config c = pio_get_default_sm_config();\n    sm_config_set_wrap(&c, offset + ${PROGRAM}_wrap_target, offset + ${PROGRAM}_wrap);\n")
+  if(SIDE_SET)
+    string(APPEND ${VAR} "    sm_config_set_sideset(&c, ${SIDE_SET}, ${SIDE_OPT}, ${SIDE_PINDIRS});\n")
+  endif()
+  string(APPEND ${VAR} "    return c;\n}\n#endif\n")
+endmacro()
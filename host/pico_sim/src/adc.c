@@ -0,0 +1,340 @@
+// ADC fed from a WAV/CSV file (PICO_SIM_ADC_INPUT) or a test tone.
+
+#define _GNU_SOURCE
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "hardware/adc.h"
+#include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "pico/time.h"
+
+#define ADC_CLOCKS_PER_SAMPLE 96
+#define ADC_FIFO_DEPTH 4
+#define NUM_ADC_INPUTS 5
+
+// 27 C on the temperature sensor: 0.706 V of a 3.3 V reference
+#define TEMP_SENSOR_CODE 876
+
+#define TONE_HZ 1000.0
+#define TONE_AMPLITUDE 1000.0
+
+static adc_hw_t adc_regs;
+adc_hw_t *const adc_hw = &adc_regs;
+
+static struct {
+  bool running;
+  uint64_t run_since;   // conversions are timed from here
+  uint64_t taken;       // conversions read since run_since
+  float clkdiv;
+  uint input;
+  uint round_robin;
+  bool byte_shift;
+
+  bool loaded;
+  uint16_t *codes;      // frames x columns of 12-bit codes
+  size_t frames;
+  uint columns;
+  size_t next[NUM_ADC_INPUTS];
+  uint64_t converted;   // for the test tone
+} adc;
+
+static uint32_t le32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint16_t le16(const uint8_t *p) {
+  return p[0] | (p[1] << 8);
+}
+
+static uint16_t clamp12(long v) {
+  return v < 0 ? 0 : v > 4095 ? 4095 : (uint16_t)v;
+}
+
+static bool load_wav(const uint8_t *data, size_t len) {
+  if (len < 12 || memcmp(data, "RIFF", 4) || memcmp(data + 8, "WAVE", 4)) return false;
+
+  uint16_t format = 0, channels = 0, bits = 0;
+  const uint8_t *samples = NULL;
+  size_t bytes = 0;
+  for (size_t pos = 12; pos + 8 <= len;) {
+    uint32_t size = le32(data + pos + 4);
+    const uint8_t *body = data + pos + 8;
+    if (size > len - pos - 8) size = len - pos - 8;
+    if (!memcmp(data + pos, "fmt ", 4) && size >= 16) {
+      format = le16(body);
+      channels = le16(body + 2);
+      bits = le16(body + 14);
+      // WAVE_FORMAT_EXTENSIBLE keeps the real format in the sub-format GUID
+      if (format == 0xfffe && size >= 26) format = le16(body + 24);
+    } else if (!memcmp(data + pos, "data", 4)) {
+      samples = body;
+      bytes = size;
+    }
+    pos += 8 + size + (size & 1);
+  }
+
+  uint width = bits / 8;
+  if (!samples || channels == 0 || width == 0 ||
+      !((format == 1 && (bits == 8 || bits == 16)) || (format == 3 && bits == 32))) {
+    fprintf(stderr, "pico_sim: only 8/16-bit PCM and 32-bit float WAV files are supported\n");
+    exit(1);
+  }
+
+  adc.columns = channels;
+  adc.frames = bytes / (width * channels);
+  adc.codes = (uint16_t *)malloc(adc.frames * channels * sizeof(uint16_t));
+  for (size_t i = 0; i < adc.frames * channels; i++) {
+    const uint8_t *s = samples + i * width;
+    if (bits == 8) {
+      adc.codes[i] = s[0] << 4;
+    } else if (bits == 16) {
+      adc.codes[i] = (uint16_t)((int16_t)le16(s) + 32768) >> 4;
+    } else {
+      float f;
+      uint32_t u = le32(s);
+      memcpy(&f, &u, sizeof(f));
+      adc.codes[i] = clamp12(lrintf((f + 1.0f) * 2048.0f));
+    }
+  }
+  return true;
+}
+
+// One frame per line, one column per ADC input. Lines that don't start
+// with a number (headers, comments) are skipped.
+static void load_csv(char *text) {
+  size_t cap = 1024;
+  adc.codes = (uint16_t *)malloc(cap * sizeof(uint16_t));
+  adc.columns = 0;
+  adc.frames = 0;
+  for (char *line = strtok(text, "\r\n"); line; line = strtok(NULL, "\r\n")) {
+    uint16_t row[NUM_ADC_INPUTS];
+    uint n = 0;
+    char *p = line;
+    while (n < NUM_ADC_INPUTS) {
+      char *end;
+      long v = strtol(p, &end, 10);
+      if (end == p) break;
+      row[n++] = clamp12(v);
+      p = end + strspn(end, " \t,;");
+    }
+    if (n == 0) continue;
+    if (adc.columns == 0) adc.columns = n;
+    if (n < adc.columns) continue;
+
+    if ((adc.frames + 1) * adc.columns > cap) {
+      cap *= 2;
+      adc.codes = (uint16_t *)realloc(adc.codes, cap * sizeof(uint16_t));
+    }
+    memcpy(adc.codes + adc.frames * adc.columns, row, adc.columns * sizeof(uint16_t));
+    adc.frames++;
+  }
+}
+
+static void load_input(void) {
+  adc.loaded = true;
+  const char *path = getenv("PICO_SIM_ADC_INPUT");
+  if (!path || !*path) return;
+
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    perror(path);
+    exit(1);
+  }
+  fseek(f, 0, SEEK_END);
+  long len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  char *data = (char *)malloc(len + 1);
+  if (fread(data, 1, len, f) != (size_t)len) {
+    perror(path);
+    exit(1);
+  }
+  data[len] = 0;
+  fclose(f);
+
+  if (!load_wav((const uint8_t *)data, len)) load_csv(data);
+  free(data);
+  if (adc.frames == 0) {
+    fprintf(stderr, "pico_sim: no samples in %s\n", path);
+    exit(1);
+  }
+}
+
+static double period_us(void) {
+  double clocks = adc.clkdiv + 1.0f;
+  if (clocks < ADC_CLOCKS_PER_SAMPLE) clocks = ADC_CLOCKS_PER_SAMPLE;
+  return clocks * 1e6 / clock_get_hz(clk_adc);
+}
+
+static uint16_t sample_code(uint input) {
+  if (input == ADC_TEMPERATURE_CHANNEL_NUM) return TEMP_SENSOR_CODE;
+
+  if (adc.codes == NULL) {
+    double t = adc.converted * period_us() * 1e-6;
+    return clamp12(lrint(2048.0 + TONE_AMPLITUDE * sin(2 * M_PI * TONE_HZ * t)));
+  }
+
+  if (adc.next[input] == adc.frames) {
+    fflush(stdout);
+    fprintf(stderr, "pico_sim: ADC input exhausted after %zu samples\n", adc.frames);
+    exit(0);
+  }
+  return adc.codes[adc.next[input]++ * adc.columns + input % adc.columns];
+}
+
+// Returns the 12-bit result
+static uint16_t convert(void) {
+  sim_hw_lock();
+  uint16_t code = sample_code(adc.input);
+  adc.converted++;
+  adc_regs.result = code;
+
+  // round robin moves on to the next enabled input after each conversion
+  if (adc.round_robin) {
+    do {
+      adc.input = (adc.input + 1) % NUM_ADC_INPUTS;
+    } while (!(adc.round_robin & (1u << adc.input)));
+  }
+  sim_hw_unlock();
+  return code;
+}
+
+uint16_t sim_adc_convert(void) {
+  uint16_t code = convert();
+  return adc.byte_shift ? code >> 4 : code;
+}
+
+bool sim_adc_is_fifo(const volatile void *addr) {
+  return addr == &adc_regs.fifo;
+}
+
+double sim_adc_period_us(void) {
+  return period_us();
+}
+
+uint64_t sim_adc_claim(uint32_t n, double *first) {
+  sim_hw_lock();
+  uint64_t done = UINT64_MAX;
+  if (adc.running) {
+    // conversions nobody read have overflowed the FIFO; they are not
+    // modelled, so the input plays back without gaps
+    uint64_t now = sim_now_us();
+    double p = period_us();
+    if (adc.run_since + (uint64_t)((adc.taken + ADC_FIFO_DEPTH) * p) < now) {
+      adc.run_since = now;
+      adc.taken = 0;
+    }
+    adc.taken += n;
+    done = adc.run_since + (uint64_t)ceil(adc.taken * p);
+    if (first) *first = adc.run_since + (adc.taken - n + 1) * p;
+  }
+  sim_hw_unlock();
+  return done;
+}
+
+void adc_init(void) {
+  sim_hw_lock();
+  if (!adc.loaded) load_input();
+  adc.running = false;
+  adc.clkdiv = 0;
+  adc.input = 0;
+  adc.round_robin = 0;
+  adc_regs.cs = 1;
+  sim_hw_unlock();
+}
+
+void adc_gpio_init(uint gpio) {
+}
+
+void adc_select_input(uint input) {
+  sim_hw_lock();
+  adc.input = input % NUM_ADC_INPUTS;
+  sim_hw_unlock();
+}
+
+uint adc_get_selected_input(void) {
+  return adc.input;
+}
+
+void adc_set_round_robin(uint input_mask) {
+  sim_hw_lock();
+  adc.round_robin = input_mask & ((1u << NUM_ADC_INPUTS) - 1);
+  sim_hw_unlock();
+}
+
+void adc_set_temp_sensor_enabled(bool enable) {
+}
+
+void adc_fifo_setup(bool en, bool dreq_en, uint16_t dreq_thresh,
+                    bool err_in_fifo, bool byte_shift) {
+  sim_hw_lock();
+  adc.byte_shift = byte_shift;
+  sim_hw_unlock();
+}
+
+void adc_set_clkdiv(float clkdiv) {
+  sim_hw_lock();
+  adc.clkdiv = clkdiv;
+  adc_regs.div = (uint32_t)(clkdiv * 256);
+  sim_hw_unlock();
+}
+
+void adc_run(bool run) {
+  sim_hw_lock();
+  bool starting = run && !adc.running;
+  adc.running = run;
+  if (starting) {
+    adc.run_since = sim_now_us();
+    adc.taken = 0;
+  }
+  sim_hw_unlock();
+  if (starting) sim_dma_adc_started();
+}
+
+uint16_t adc_read(void) {
+  sleep_us((uint64_t)ceil(ADC_CLOCKS_PER_SAMPLE * 1e6 / clock_get_hz(clk_adc)));
+  return convert();
+}
+
+bool adc_fifo_is_empty(void) {
+  return adc_fifo_get_level() == 0;
+}
+
+uint8_t adc_fifo_get_level(void) {
+  sim_hw_lock();
+  uint8_t level = 0;
+  if (adc.running) {
+    uint64_t converted = (uint64_t)((sim_now_us() - adc.run_since) / period_us());
+    if (converted > adc.taken) {
+      level = converted - adc.taken > ADC_FIFO_DEPTH ? ADC_FIFO_DEPTH
+                                                     : (uint8_t)(converted - adc.taken);
+    }
+  }
+  sim_hw_unlock();
+  return level;
+}
+
+uint16_t adc_fifo_get(void) {
+  if (sim_adc_claim(1, NULL) == UINT64_MAX) return 0;
+  return sim_adc_convert();
+}
+
+uint16_t adc_fifo_get_blocking(void) {
+  uint64_t done = sim_adc_claim(1, NULL);
+  if (done == UINT64_MAX) {
+    // nothing will ever arrive, as on the hardware
+    for (;;) __wfe();
+  }
+  sleep_until(done);
+  return sim_adc_convert();
+}
+
+void adc_fifo_drain(void) {
+  sim_hw_lock();
+  adc.run_since = sim_now_us();
+  adc.taken = 0;
+  sim_hw_unlock();
+}
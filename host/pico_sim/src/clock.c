@@ -0,0 +1,222 @@
+// Virtual clock, event thread, sleeps, WFE/SEV and interrupt masking.
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <time.h>
+
+#include "sim.h"
+#include "pico/time.h"
+#include "hardware/sync.h"
+
+const absolute_time_t at_the_end_of_time = UINT64_MAX;
+const absolute_time_t nil_time = 0;
+
+static pthread_mutex_t clock_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Signalled when the clock jumps or the event queue changes
+static pthread_cond_t clock_cond;
+// Signalled when the event thread has caught up with the clock
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+static uint64_t real_start;  // host monotonic time at boot
+static uint64_t offset;      // how far the virtual clock is ahead of it
+static uint64_t done_until;  // every event due by this time has run
+static sim_event_t *queue;   // pending events, soonest first
+static bool event_thread_started;
+static __thread bool on_event_thread;
+// The time of the event being fired; the clock reads this on the event
+// thread, as if the handler ran the moment its event was due
+static __thread uint64_t event_now;
+
+static pthread_mutex_t hw_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static pthread_mutex_t irq_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+static __thread uint32_t irq_disabled;
+
+static uint64_t real_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000ull + ts.tv_nsec / 1000;
+}
+
+__attribute__((constructor)) static void clock_boot(void) {
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&clock_cond, &attr);
+  pthread_condattr_destroy(&attr);
+  real_start = real_us();
+}
+
+static uint64_t now_locked(void) {
+  return real_us() - real_start + offset;
+}
+
+uint64_t sim_now_us(void) {
+  if (on_event_thread) return event_now;
+  pthread_mutex_lock(&clock_mutex);
+  uint64_t t = now_locked();
+  pthread_mutex_unlock(&clock_mutex);
+  return t;
+}
+
+uint64_t time_us_64(void) {
+  return sim_now_us();
+}
+
+static void *event_main(void *arg) {
+  on_event_thread = true;
+  pthread_mutex_lock(&clock_mutex);
+  for (;;) {
+    uint64_t now = now_locked();
+    sim_event_t *e = queue;
+    if (e && e->when <= now) {
+      queue = e->next;
+      e->queued = false;
+      event_now = e->when;
+      pthread_mutex_unlock(&clock_mutex);
+      uint32_t status = save_and_disable_interrupts();
+      e->fire(e);
+      restore_interrupts(status);
+      pthread_mutex_lock(&clock_mutex);
+      continue;
+    }
+
+    done_until = now;
+    pthread_cond_broadcast(&done_cond);
+    if (e == NULL) {
+      pthread_cond_wait(&clock_cond, &clock_mutex);
+    } else {
+      // the clock may jump before then, which signals clock_cond
+      uint64_t wake = real_us() + (e->when - now);
+      struct timespec ts = { (time_t)(wake / 1000000), (long)(wake % 1000000) * 1000 };
+      pthread_cond_timedwait(&clock_cond, &clock_mutex, &ts);
+    }
+  }
+  return NULL;
+}
+
+bool sim_events_blocked(void) {
+  return on_event_thread || irq_disabled;
+}
+
+void sim_wait_until(uint64_t t) {
+  pthread_mutex_lock(&clock_mutex);
+  uint64_t now = now_locked();
+  if (t > now) {
+    offset += t - now;
+    pthread_cond_broadcast(&clock_cond);
+  }
+  if (event_thread_started && !sim_events_blocked()) {
+    while (done_until < t) pthread_cond_wait(&done_cond, &clock_mutex);
+  }
+  pthread_mutex_unlock(&clock_mutex);
+}
+
+static void unlink_locked(sim_event_t *e) {
+  for (sim_event_t **p = &queue; *p; p = &(*p)->next) {
+    if (*p == e) {
+      *p = e->next;
+      break;
+    }
+  }
+  e->queued = false;
+}
+
+void sim_event_schedule(sim_event_t *e, uint64_t when) {
+  pthread_mutex_lock(&clock_mutex);
+  if (e->queued) unlink_locked(e);
+  e->when = when;
+  sim_event_t **p = &queue;
+  while (*p && (*p)->when <= when) p = &(*p)->next;
+  e->next = *p;
+  *p = e;
+  e->queued = true;
+
+  if (!event_thread_started) {
+    pthread_t thread;
+    pthread_create(&thread, NULL, event_main, NULL);
+    pthread_detach(thread);
+    event_thread_started = true;
+  }
+  pthread_cond_broadcast(&clock_cond);
+  pthread_mutex_unlock(&clock_mutex);
+}
+
+void sim_event_cancel(sim_event_t *e) {
+  pthread_mutex_lock(&clock_mutex);
+  if (e->queued) unlink_locked(e);
+  pthread_mutex_unlock(&clock_mutex);
+}
+
+void sim_hw_lock(void) {
+  pthread_mutex_lock(&hw_mutex);
+}
+
+void sim_hw_unlock(void) {
+  pthread_mutex_unlock(&hw_mutex);
+}
+
+void sleep_until(absolute_time_t target) {
+  sim_wait_until(target);
+}
+
+void sleep_us(uint64_t us) {
+  sim_wait_until(delayed_by_us(sim_now_us(), us));
+}
+
+void sleep_ms(uint32_t ms) {
+  sleep_us(ms * 1000ull);
+}
+
+void busy_wait_us(uint64_t delay_us) {
+  if (on_event_thread) {
+    event_now += delay_us;
+    return;
+  }
+  uint64_t end = sim_now_us() + delay_us;
+  while (sim_now_us() < end) tight_loop_contents();
+}
+
+// ---- WFE/SEV ----
+
+static pthread_mutex_t event_flag_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t event_flag_cond;
+static bool event_flag[2];
+
+__attribute__((constructor)) static void event_flag_init(void) {
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&event_flag_cond, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+void __sev(void) {
+  pthread_mutex_lock(&event_flag_mutex);
+  event_flag[0] = event_flag[1] = true;
+  pthread_cond_broadcast(&event_flag_cond);
+  pthread_mutex_unlock(&event_flag_mutex);
+}
+
+void __wfe(void) {
+  uint core = get_core_num();
+  pthread_mutex_lock(&event_flag_mutex);
+  if (!event_flag[core]) {
+    uint64_t wake = real_us() + 1000;
+    struct timespec ts = { (time_t)(wake / 1000000), (long)(wake % 1000000) * 1000 };
+    pthread_cond_timedwait(&event_flag_cond, &event_flag_mutex, &ts);
+  }
+  event_flag[core] = false;
+  pthread_mutex_unlock(&event_flag_mutex);
+}
+
+// ---- Interrupt masking ----
+
+uint32_t save_and_disable_interrupts(void) {
+  pthread_mutex_lock(&irq_mutex);
+  return irq_disabled++;
+}
+
+void restore_interrupts(uint32_t status) {
+  irq_disabled = status;
+  pthread_mutex_unlock(&irq_mutex);
+}
@@ -0,0 +1,379 @@
+// DMA channels, paced by the ADC or a PIO state machine on the virtual clock.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+
+typedef struct {
+  sim_event_t done;     // completion; must stay first
+  bool claimed;
+  bool busy;
+  uint32_t ctrl;
+  const volatile void *read_addr;
+  volatile void *write_addr;
+  uint32_t count;       // transfer count loaded on the next trigger
+  uint32_t total;       // transfer count of the running transfer
+  uint32_t remaining;   // transfers left in the running transfer
+  uint64_t done_at;     // UINT64_MAX while waiting for the ADC to start
+  double adc_first;     // when the first ADC sample of the transfer is ready
+} dma_chan_t;
+
+// ADC transfers are written out in steps while they run, so software
+// watching the write address or transfer count sees progress. A step is
+// this long, or this many samples at slow rates.
+#define ADC_PROGRESS_US 1000
+#define ADC_PROGRESS_SAMPLES 64
+
+static dma_chan_t chans[NUM_DMA_CHANNELS];
+static dma_hw_t dma_regs;
+dma_hw_t *const dma_hw = &dma_regs;
+
+static void panic_channel(const char *what, uint channel) {
+  fprintf(stderr, "pico_sim: DMA channel %u %s\n", channel, what);
+  abort();
+}
+
+static uint ctrl_field(uint32_t ctrl, uint32_t bits, uint lsb) {
+  return (ctrl & bits) >> lsb;
+}
+
+// Address of element i, honouring increment and the ring on one side
+static uintptr_t element_addr(uintptr_t base, uint32_t i, uint size, uint32_t ctrl, bool write) {
+  uint32_t incr = write ? DMA_CH0_CTRL_TRIG_INCR_WRITE_BITS : DMA_CH0_CTRL_TRIG_INCR_READ_BITS;
+  if (!(ctrl & incr)) return base;
+  uintptr_t offset = (uintptr_t)i * size;
+  uint ring = ctrl_field(ctrl, DMA_CH0_CTRL_TRIG_RING_SIZE_BITS, DMA_CH0_CTRL_TRIG_RING_SIZE_LSB);
+  if (ring && !(ctrl & DMA_CH0_CTRL_TRIG_RING_SEL_BITS) == !write) {
+    uintptr_t mask = ((uintptr_t)1 << ring) - 1;
+    return (base & ~mask) | ((base + offset) & mask);
+  }
+  return base + offset;
+}
+
+static uint32_t read_element(uintptr_t addr, uint size) {
+  switch (size) {
+  case 1: return *(const volatile uint8_t *)addr;
+  case 2: return *(const volatile uint16_t *)addr;
+  default: return *(const volatile uint32_t *)addr;
+  }
+}
+
+static void write_element(uintptr_t addr, uint size, uint32_t v) {
+  switch (size) {
+  case 1: *(volatile uint8_t *)addr = (uint8_t)v; break;
+  case 2: *(volatile uint16_t *)addr = (uint16_t)v; break;
+  default: *(volatile uint32_t *)addr = v; break;
+  }
+}
+
+static uint32_t bswap(uint32_t v, uint size) {
+  return size == 4 ? __builtin_bswap32(v) : size == 2 ? __builtin_bswap16((uint16_t)v) : v;
+}
+
+static void dma_complete(uint channel);
+
+// Stores the ADC samples of the running transfer that are ready by time
+// t. Called with the hardware lock held.
+static void dma_fill_adc(uint channel, uint64_t t) {
+  dma_chan_t *c = &chans[channel];
+  uint size = 1u << ctrl_field(c->ctrl, DMA_CH0_CTRL_TRIG_DATA_SIZE_BITS, DMA_CH0_CTRL_TRIG_DATA_SIZE_LSB);
+  uintptr_t dst = (uintptr_t)c->write_addr;
+  uint32_t from = c->total - c->remaining;
+  uint32_t to = c->total;
+  if (t < c->done_at) {
+    double ready = t < c->adc_first ? 0 : floor((t - c->adc_first) / sim_adc_period_us()) + 1;
+    if (ready < to) to = (uint32_t)ready;
+  }
+  for (uint32_t i = from; i < to; i++) {
+    uint32_t v = sim_adc_convert();
+    if (c->ctrl & DMA_CH0_CTRL_TRIG_BSWAP_BITS) v = bswap(v, size);
+    write_element(element_addr(dst, i, size, c->ctrl, true), size, v);
+  }
+  if (to > from) {
+    c->remaining = c->total - to;
+    dma_regs.ch[channel].write_addr = element_addr(dst, to, size, c->ctrl, true);
+    dma_regs.ch[channel].transfer_count = c->remaining;
+  }
+}
+
+// When the next step of an ADC transfer is due
+static uint64_t adc_step(dma_chan_t *c, uint64_t now) {
+  double step = ADC_PROGRESS_SAMPLES * sim_adc_period_us();
+  uint64_t next = now + (step > ADC_PROGRESS_US ? (uint64_t)step : ADC_PROGRESS_US);
+  return next < c->done_at ? next : c->done_at;
+}
+
+static void dma_done_event(sim_event_t *e) {
+  uint channel = (uint)((dma_chan_t *)e - chans);
+  dma_chan_t *c = &chans[channel];
+  uint64_t now = sim_now_us();
+
+  sim_hw_lock();
+  if (c->busy && c->remaining && now < c->done_at) {
+    dma_fill_adc(channel, now);
+    sim_event_schedule(&c->done, adc_step(c, now));
+    sim_hw_unlock();
+    return;
+  }
+  sim_hw_unlock();
+  dma_complete(channel);
+}
+
+
+// Called with the hardware lock held
+static void dma_trigger(uint channel) {
+  dma_chan_t *c = &chans[channel];
+  if (!(c->ctrl & DMA_CH0_CTRL_TRIG_EN_BITS)) return;
+  sim_event_cancel(&c->done);
+
+  uint size = 1u << ctrl_field(c->ctrl, DMA_CH0_CTRL_TRIG_DATA_SIZE_BITS, DMA_CH0_CTRL_TRIG_DATA_SIZE_LSB);
+  uintptr_t src = (uintptr_t)c->read_addr;
+  uintptr_t dst = (uintptr_t)c->write_addr;
+  uint32_t n = c->count;
+  PIO pio;
+  uint sm;
+
+  c->busy = true;
+  c->total = n;
+  c->remaining = n;
+  dma_regs.ch[channel].transfer_count = n;
+  uint64_t now = sim_now_us();
+  c->done_at = now;
+
+  if (sim_adc_is_fifo(c->read_addr)) {
+    // data is read from the ADC in steps as the transfer runs
+    c->done_at = sim_adc_claim(n, &c->adc_first);
+  } else if (sim_pio_find_txf(c->write_addr, &pio, &sm)) {
+    // the whole transfer is queued at once, as if the FIFO never filled
+    for (uint32_t i = 0; i < n; i++) {
+      uint32_t v = read_element(element_addr(src, i, size, c->ctrl, false), size);
+      if (c->ctrl & DMA_CH0_CTRL_TRIG_BSWAP_BITS) v = bswap(v, size);
+      c->done_at = sim_pio_push(pio, sm, v, now);
+    }
+    c->remaining = 0;
+  } else {
+    for (uint32_t i = 0; i < n; i++) {
+      uint32_t v = read_element(element_addr(src, i, size, c->ctrl, false), size);
+      if (c->ctrl & DMA_CH0_CTRL_TRIG_BSWAP_BITS) v = bswap(v, size);
+      write_element(element_addr(dst, i, size, c->ctrl, true), size, v);
+    }
+    c->remaining = 0;
+  }
+
+  if (c->done_at == UINT64_MAX) return;
+  sim_event_schedule(&c->done, sim_adc_is_fifo(c->read_addr) ? adc_step(c, now) : c->done_at);
+}
+
+static void dma_complete(uint channel) {
+  dma_chan_t *c = &chans[channel];
+  uint32_t bit = 1u << channel;
+
+  sim_hw_lock();
+  if (!c->busy) {
+    sim_hw_unlock();
+    return;
+  }
+  if (c->remaining) dma_fill_adc(channel, c->done_at);
+  c->busy = false;
+  c->remaining = 0;
+
+  // the addresses are left where the transfer ended, as on the hardware
+  uint size = 1u << ctrl_field(c->ctrl, DMA_CH0_CTRL_TRIG_DATA_SIZE_BITS, DMA_CH0_CTRL_TRIG_DATA_SIZE_LSB);
+  c->read_addr = (const volatile void *)element_addr((uintptr_t)c->read_addr, c->total, size, c->ctrl, false);
+  c->write_addr = (volatile void *)element_addr((uintptr_t)c->write_addr, c->total, size, c->ctrl, true);
+  dma_regs.ch[channel].read_addr = (uintptr_t)c->read_addr;
+  dma_regs.ch[channel].write_addr = (uintptr_t)c->write_addr;
+  dma_regs.ch[channel].transfer_count = 0;
+
+  bool raise0 = false, raise1 = false;
+  if (!(c->ctrl & DMA_CH0_CTRL_TRIG_IRQ_QUIET_BITS)) {
+    dma_regs.intr |= bit;
+    if (dma_regs.inte0 & bit) {
+      dma_regs.ints0 |= bit;
+      raise0 = true;
+    }
+    if (dma_regs.inte1 & bit) {
+      dma_regs.ints1 |= bit;
+      raise1 = true;
+    }
+  }
+  uint chain = ctrl_field(c->ctrl, DMA_CH0_CTRL_TRIG_CHAIN_TO_BITS, DMA_CH0_CTRL_TRIG_CHAIN_TO_LSB);
+  sim_hw_unlock();
+
+  // A handler acknowledges by writing its bit to INTS; here the bit is
+  // cleared for it once the handlers have run
+  if (raise0 && sim_irq_raise(DMA_IRQ_0)) dma_regs.ints0 &= ~bit;
+  if (raise1 && sim_irq_raise(DMA_IRQ_1)) dma_regs.ints1 &= ~bit;
+  if (raise0 || raise1) dma_regs.intr &= ~bit;
+
+  if (chain != channel) {
+    sim_hw_lock();
+    dma_trigger(chain);
+    sim_hw_unlock();
+  }
+}
+
+void sim_dma_adc_started(void) {
+  sim_hw_lock();
+  for (uint i = 0; i < NUM_DMA_CHANNELS; i++) {
+    dma_chan_t *c = &chans[i];
+    if (c->busy && c->done_at == UINT64_MAX && sim_adc_is_fifo(c->read_addr)) {
+      c->done_at = sim_adc_claim(c->remaining, &c->adc_first);
+      sim_event_schedule(&c->done, adc_step(c, sim_now_us()));
+    }
+  }
+  sim_hw_unlock();
+}
+
+void dma_channel_claim(uint channel) {
+  sim_hw_lock();
+  if (chans[channel].claimed) panic_channel("is already claimed", channel);
+  chans[channel].claimed = true;
+  chans[channel].done.fire = dma_done_event;
+  sim_hw_unlock();
+}
+
+int dma_claim_unused_channel(bool required) {
+  int channel = -1;
+  sim_hw_lock();
+  for (uint i = 0; i < NUM_DMA_CHANNELS; i++) {
+    if (!chans[i].claimed) {
+      dma_channel_claim(i);
+      channel = (int)i;
+      break;
+    }
+  }
+  sim_hw_unlock();
+  if (channel < 0 && required) {
+    fprintf(stderr, "pico_sim: no DMA channels are available\n");
+    abort();
+  }
+  return channel;
+}
+
+void dma_channel_unclaim(uint channel) {
+  sim_hw_lock();
+  chans[channel].claimed = false;
+  sim_hw_unlock();
+}
+
+bool dma_channel_is_claimed(uint channel) {
+  return chans[channel].claimed;
+}
+
+void dma_channel_set_config(uint channel, const dma_channel_config *config, bool trigger) {
+  sim_hw_lock();
+  chans[channel].ctrl = config->ctrl;
+  dma_regs.ch[channel].ctrl_trig = config->ctrl;
+  if (trigger) dma_trigger(channel);
+  sim_hw_unlock();
+}
+
+void dma_channel_set_read_addr(uint channel, const volatile void *read_addr, bool trigger) {
+  sim_hw_lock();
+  chans[channel].read_addr = read_addr;
+  dma_regs.ch[channel].read_addr = (uintptr_t)read_addr;
+  if (trigger) dma_trigger(channel);
+  sim_hw_unlock();
+}
+
+void dma_channel_set_write_addr(uint channel, volatile void *write_addr, bool trigger) {
+  sim_hw_lock();
+  chans[channel].write_addr = write_addr;
+  dma_regs.ch[channel].write_addr = (uintptr_t)write_addr;
+  if (trigger) dma_trigger(channel);
+  sim_hw_unlock();
+}
+
+void dma_channel_set_trans_count(uint channel, uint32_t trans_count, bool trigger) {
+  sim_hw_lock();
+  chans[channel].count = trans_count;
+  if (trigger) dma_trigger(channel);
+  sim_hw_unlock();
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config,
+                           volatile void *write_addr, const volatile void *read_addr,
+                           uint transfer_count, bool trigger) {
+  sim_hw_lock();
+  dma_channel_set_read_addr(channel, read_addr, false);
+  dma_channel_set_write_addr(channel, write_addr, false);
+  dma_channel_set_trans_count(channel, transfer_count, false);
+  dma_channel_set_config(channel, config, trigger);
+  sim_hw_unlock();
+}
+
+void dma_channel_transfer_from_buffer_now(uint channel, const volatile void *read_addr,
+                                          uint32_t transfer_count) {
+  sim_hw_lock();
+  dma_channel_set_read_addr(channel, read_addr, false);
+  dma_channel_set_trans_count(channel, transfer_count, true);
+  sim_hw_unlock();
+}
+
+void dma_channel_transfer_to_buffer_now(uint channel, volatile void *write_addr,
+                                        uint32_t transfer_count) {
+  sim_hw_lock();
+  dma_channel_set_write_addr(channel, write_addr, false);
+  dma_channel_set_trans_count(channel, transfer_count, true);
+  sim_hw_unlock();
+}
+
+void dma_start_channel_mask(uint32_t chan_mask) {
+  sim_hw_lock();
+  for (uint i = 0; i < NUM_DMA_CHANNELS; i++) {
+    if (chan_mask & (1u << i)) dma_trigger(i);
+  }
+  sim_hw_unlock();
+}
+
+void dma_channel_abort(uint channel) {
+  sim_hw_lock();
+  sim_event_cancel(&chans[channel].done);
+  chans[channel].busy = false;
+  chans[channel].remaining = 0;
+  sim_hw_unlock();
+}
+
+bool dma_channel_is_busy(uint channel) {
+  return chans[channel].busy;
+}
+
+void dma_channel_wait_for_finish_blocking(uint channel) {
+  dma_chan_t *c = &chans[channel];
+  while (c->busy) {
+    sim_hw_lock();
+    uint64_t done_at = c->done_at;
+    sim_hw_unlock();
+    if (done_at == UINT64_MAX) {
+      // waiting for another core to start the ADC
+      __sync_synchronize();
+      continue;
+    }
+    sim_wait_until(done_at);
+    if (sim_events_blocked()) {
+      // the event thread can't complete it for us
+      sim_event_cancel(&c->done);
+      dma_complete(channel);
+    }
+  }
+}
+
+void dma_channel_set_irq0_enabled(uint channel, bool enabled) {
+  sim_hw_lock();
+  if (enabled) dma_regs.inte0 |= 1u << channel;
+  else dma_regs.inte0 &= ~(1u << channel);
+  sim_hw_unlock();
+}
+
+void dma_channel_set_irq1_enabled(uint channel, bool enabled) {
+  sim_hw_lock();
+  if (enabled) dma_regs.inte1 |= 1u << channel;
+  else dma_regs.inte1 &= ~(1u << channel);
+  sim_hw_unlock();
+}
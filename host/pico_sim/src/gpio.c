@@ -0,0 +1,89 @@
+// GPIO state, clock frequencies and the system PLL.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim.h"
+#include "hardware/clocks.h"
+#include "hardware/gpio.h"
+#include "pico/stdlib.h"
+
+static bool gpio_out[NUM_BANK0_GPIOS];
+static bool gpio_value[NUM_BANK0_GPIOS];
+
+void gpio_init(uint gpio) {
+  gpio_out[gpio] = false;
+  gpio_value[gpio] = false;
+}
+
+void gpio_set_function(uint gpio, enum gpio_function fn) {
+}
+
+void gpio_set_dir(uint gpio, bool out) {
+  gpio_out[gpio] = out;
+}
+
+void gpio_put(uint gpio, bool value) {
+  gpio_value[gpio] = value;
+}
+
+bool gpio_get(uint gpio) {
+  return gpio_value[gpio];
+}
+
+static uint32_t clock_hz[CLK_COUNT] = {
+  [clk_ref] = 12000000,
+  [clk_sys] = 125000000,
+  [clk_peri] = 125000000,
+  [clk_usb] = 48000000,
+  [clk_adc] = 48000000,
+  [clk_rtc] = 46875,
+};
+
+uint32_t clock_get_hz(enum clock_index clk_index) {
+  return clk_index < CLK_COUNT ? clock_hz[clk_index] : 0;
+}
+
+bool clock_configure(enum clock_index clk_index, uint32_t src, uint32_t auxsrc,
+                     uint32_t src_freq, uint32_t freq) {
+  if (clk_index >= CLK_COUNT || freq > src_freq) return false;
+  clock_hz[clk_index] = freq;
+  return true;
+}
+
+// The SDK's search: the fastest VCO first, then the post dividers
+bool check_sys_clock_khz(uint32_t freq_khz, uint *vco_out,
+                         uint *postdiv1_out, uint *postdiv2_out) {
+  uint32_t ref_khz = clock_hz[clk_ref] / 1000;
+  for (uint fbdiv = 320; fbdiv >= 16; fbdiv--) {
+    uint32_t vco_khz = fbdiv * ref_khz;
+    if (vco_khz < 750000 || vco_khz > 1600000) continue;
+    for (uint postdiv1 = 7; postdiv1 >= 1; postdiv1--) {
+      for (uint postdiv2 = postdiv1; postdiv2 >= 1; postdiv2--) {
+        if (vco_khz == freq_khz * postdiv1 * postdiv2) {
+          *vco_out = vco_khz * 1000;
+          *postdiv1_out = postdiv1;
+          *postdiv2_out = postdiv2;
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+bool set_sys_clock_khz(uint32_t freq_khz, bool required) {
+  uint vco, postdiv1, postdiv2;
+  if (!check_sys_clock_khz(freq_khz, &vco, &postdiv1, &postdiv2)) {
+    if (required) {
+      fprintf(stderr, "pico_sim: no PLL setting for a %u kHz clk_sys\n",
+              (unsigned)freq_khz);
+      abort();
+    }
+    return false;
+  }
+  sim_hw_lock();
+  clock_hz[clk_sys] = clock_hz[clk_peri] = freq_khz * 1000;
+  sim_hw_unlock();
+  return true;
+}
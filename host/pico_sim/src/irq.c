@@ -0,0 +1,67 @@
+// Interrupt handler tables. Handlers are called by sim_irq_raise(), which
+// the peripherals use from the event thread.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim.h"
+#include "hardware/irq.h"
+
+#define MAX_SHARED_HANDLERS 4
+
+static irq_handler_t handlers[NUM_IRQS][MAX_SHARED_HANDLERS];
+static uint num_handlers[NUM_IRQS];
+static bool enabled[NUM_IRQS];
+
+void irq_set_exclusive_handler(uint num, irq_handler_t handler) {
+  sim_hw_lock();
+  handlers[num][0] = handler;
+  num_handlers[num] = 1;
+  sim_hw_unlock();
+}
+
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t order_priority) {
+  sim_hw_lock();
+  if (num_handlers[num] == MAX_SHARED_HANDLERS) {
+    fprintf(stderr, "pico_sim: too many handlers for IRQ %u\n", num);
+    abort();
+  }
+  handlers[num][num_handlers[num]++] = handler;
+  sim_hw_unlock();
+}
+
+void irq_remove_handler(uint num, irq_handler_t handler) {
+  sim_hw_lock();
+  for (uint i = 0; i < num_handlers[num]; i++) {
+    if (handlers[num][i] == handler) {
+      for (uint j = i + 1; j < num_handlers[num]; j++) handlers[num][j - 1] = handlers[num][j];
+      num_handlers[num]--;
+      break;
+    }
+  }
+  sim_hw_unlock();
+}
+
+void irq_set_enabled(uint num, bool enable) {
+  sim_hw_lock();
+  enabled[num] = enable;
+  sim_hw_unlock();
+}
+
+bool irq_is_enabled(uint num) {
+  return enabled[num];
+}
+
+bool sim_irq_raise(uint num) {
+  irq_handler_t run[MAX_SHARED_HANDLERS];
+  uint n = 0;
+  sim_hw_lock();
+  if (enabled[num]) {
+    n = num_handlers[num];
+    for (uint i = 0; i < n; i++) run[i] = handlers[num][i];
+  }
+  sim_hw_unlock();
+
+  for (uint i = 0; i < n; i++) run[i]();
+  return n > 0;
+}
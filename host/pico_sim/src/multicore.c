@@ -0,0 +1,115 @@
+// Core 1 as a host thread, and the SIO FIFOs between the cores.
+
+#include <pthread.h>
+#include <time.h>
+
+#include "sim.h"
+#include "pico/multicore.h"
+
+#define SIO_FIFO_DEPTH 8
+
+typedef struct {
+  uint32_t data[SIO_FIFO_DEPTH];
+  uint head;
+  uint count;
+  pthread_mutex_t mutex;
+  pthread_cond_t changed;
+} sio_fifo_t;
+
+// fifo[n] is the one core n reads from
+static sio_fifo_t fifo[2] = {
+  { {0}, 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER },
+  { {0}, 0, 0, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER },
+};
+
+static __thread uint core_num;
+static void (*core1_entry)(void);
+
+uint get_core_num(void) {
+  return core_num;
+}
+
+static void *core1_main(void *arg) {
+  core_num = 1;
+  core1_entry();
+  return NULL;
+}
+
+void multicore_launch_core1(void (*entry)(void)) {
+  pthread_t thread;
+  core1_entry = entry;
+  pthread_create(&thread, NULL, core1_main, NULL);
+  pthread_detach(thread);
+}
+
+bool multicore_fifo_rvalid(void) {
+  sio_fifo_t *f = &fifo[core_num];
+  pthread_mutex_lock(&f->mutex);
+  bool valid = f->count > 0;
+  pthread_mutex_unlock(&f->mutex);
+  return valid;
+}
+
+bool multicore_fifo_wready(void) {
+  sio_fifo_t *f = &fifo[core_num ^ 1];
+  pthread_mutex_lock(&f->mutex);
+  bool ready = f->count < SIO_FIFO_DEPTH;
+  pthread_mutex_unlock(&f->mutex);
+  return ready;
+}
+
+void multicore_fifo_push_blocking(uint32_t data) {
+  sio_fifo_t *f = &fifo[core_num ^ 1];
+  pthread_mutex_lock(&f->mutex);
+  while (f->count == SIO_FIFO_DEPTH) pthread_cond_wait(&f->changed, &f->mutex);
+  f->data[(f->head + f->count++) % SIO_FIFO_DEPTH] = data;
+  pthread_cond_broadcast(&f->changed);
+  pthread_mutex_unlock(&f->mutex);
+  // a FIFO write wakes the other core from WFE
+  __sev();
+}
+
+static uint32_t pop_locked(sio_fifo_t *f) {
+  uint32_t data = f->data[f->head];
+  f->head = (f->head + 1) % SIO_FIFO_DEPTH;
+  f->count--;
+  pthread_cond_broadcast(&f->changed);
+  return data;
+}
+
+uint32_t multicore_fifo_pop_blocking(void) {
+  sio_fifo_t *f = &fifo[core_num];
+  pthread_mutex_lock(&f->mutex);
+  while (f->count == 0) pthread_cond_wait(&f->changed, &f->mutex);
+  uint32_t data = pop_locked(f);
+  pthread_mutex_unlock(&f->mutex);
+  return data;
+}
+
+// The timeout is in real time, since the other core is a real thread
+bool multicore_fifo_pop_timeout_us(uint64_t timeout_us, uint32_t *out) {
+  sio_fifo_t *f = &fifo[core_num];
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  uint64_t ns = ts.tv_nsec + timeout_us * 1000;
+  ts.tv_sec += ns / 1000000000;
+  ts.tv_nsec = ns % 1000000000;
+
+  pthread_mutex_lock(&f->mutex);
+  while (f->count == 0) {
+    if (pthread_cond_timedwait(&f->changed, &f->mutex, &ts)) break;
+  }
+  bool got = f->count > 0;
+  if (got) *out = pop_locked(f);
+  pthread_mutex_unlock(&f->mutex);
+  return got;
+}
+
+void multicore_fifo_drain(void) {
+  sio_fifo_t *f = &fifo[core_num];
+  pthread_mutex_lock(&f->mutex);
+  f->head = 0;
+  f->count = 0;
+  pthread_cond_broadcast(&f->changed);
+  pthread_mutex_unlock(&f->mutex);
+}
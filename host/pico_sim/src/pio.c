@@ -0,0 +1,314 @@
+// PIO state machines that shift out their TX FIFO data and record it.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sim.h"
+#include "hardware/pio.h"
+#include "hardware/clocks.h"
+#include "pico/time.h"
+
+typedef struct {
+  bool claimed;
+  bool enabled;
+  pio_sm_config config;
+  uint out_bits;       // width of the program's `out`
+  double busy_until;   // virtual time the last queued word has been sent
+  uint64_t burst_start;
+  uint8_t *bits;       // data sent in the current burst, MSB first
+  size_t num_bits;
+  size_t cap_bits;
+} sm_t;
+
+static pio_hw_t pio_regs[NUM_PIOS];
+pio_hw_t *const pio0 = &pio_regs[0];
+pio_hw_t *const pio1 = &pio_regs[1];
+
+static sm_t sms[NUM_PIOS][NUM_PIO_STATE_MACHINES];
+static uint32_t used_instructions[NUM_PIOS];
+static uint8_t out_bits_at[NUM_PIOS][PIO_INSTRUCTION_COUNT];
+
+static FILE *record;
+static bool record_checked;
+
+static void flush_burst(uint p, uint sm) {
+  sm_t *s = &sms[p][sm];
+  if (s->num_bits == 0) return;
+  if (record) {
+    fprintf(record, "%llu pio%u sm%u %zu ", (unsigned long long)s->burst_start, p, sm, s->num_bits);
+    for (size_t i = 0; i < (s->num_bits + 7) / 8; i++) fprintf(record, "%02x", s->bits[i]);
+    fputc('\n', record);
+    fflush(record);
+  }
+  s->num_bits = 0;
+}
+
+static void flush_all(void) {
+  sim_hw_lock();
+  for (uint p = 0; p < NUM_PIOS; p++) {
+    for (uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) flush_burst(p, sm);
+  }
+  sim_hw_unlock();
+}
+
+static void open_record(void) {
+  record_checked = true;
+  const char *path = getenv("PICO_SIM_PIO_OUTPUT");
+  if (!path || !*path) return;
+  record = fopen(path, "w");
+  if (!record) {
+    perror(path);
+    exit(1);
+  }
+  atexit(flush_all);
+}
+
+static void record_bits(sm_t *s, uint32_t value, uint n) {
+  if (!record) return;
+  if (s->num_bits + n > s->cap_bits) {
+    s->cap_bits = s->cap_bits ? s->cap_bits * 2 : 4096;
+    s->bits = (uint8_t *)realloc(s->bits, s->cap_bits / 8);
+  }
+  for (uint i = n; i-- > 0;) {
+    size_t byte = s->num_bits / 8;
+    uint8_t mask = 0x80 >> (s->num_bits % 8);
+    if (s->num_bits % 8 == 0) s->bits[byte] = 0;
+    if (value & (1u << i)) s->bits[byte] |= mask;
+    s->num_bits++;
+  }
+}
+
+static uint pull_threshold(const sm_t *s) {
+  uint t = (s->config.shiftctrl & PIO_SM0_SHIFTCTRL_PULL_THRESH_BITS) >> PIO_SM0_SHIFTCTRL_PULL_THRESH_LSB;
+  return t ? t : 32;
+}
+
+static uint fifo_depth(const sm_t *s) {
+  return (s->config.shiftctrl & PIO_SM0_SHIFTCTRL_FJOIN_TX_BITS) ? 8 : 4;
+}
+
+// Time to shift one FIFO word out of the OSR
+static double word_us(const sm_t *s) {
+  double div = (s->config.clkdiv >> PIO_SM0_CLKDIV_INT_LSB) +
+               ((s->config.clkdiv >> PIO_SM0_CLKDIV_FRAC_LSB) & 0xff) / 256.0;
+  if (div == 0) div = 65536;
+  uint outs = (pull_threshold(s) + s->out_bits - 1) / s->out_bits;
+  return outs * PIO_SIM_CYCLES_PER_OUT * div * 1e6 / clock_get_hz(clk_sys);
+}
+
+bool sim_pio_find_txf(const volatile void *addr, PIO *pio, uint *sm) {
+  for (uint p = 0; p < NUM_PIOS; p++) {
+    for (uint i = 0; i < NUM_PIO_STATE_MACHINES; i++) {
+      if (addr == &pio_regs[p].txf[i]) {
+        *pio = &pio_regs[p];
+        *sm = i;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+uint64_t sim_pio_push(PIO pio, uint sm, uint32_t data, uint64_t now) {
+  uint p = pio_get_index(pio);
+  sm_t *s = &sms[p][sm];
+
+  sim_hw_lock();
+  if (!record_checked) open_record();
+  if (s->busy_until < now) {
+    // the line went idle, so this starts a new burst
+    flush_burst(p, sm);
+    s->busy_until = now;
+    s->burst_start = now;
+  }
+
+  uint threshold = pull_threshold(s);
+  bool shift_right = s->config.shiftctrl & PIO_SM0_SHIFTCTRL_OUT_SHIFTDIR_BITS;
+  uint32_t osr = data;
+  for (uint done = 0; done < threshold; done += s->out_bits) {
+    uint n = s->out_bits < threshold - done ? s->out_bits : threshold - done;
+    uint32_t mask = n == 32 ? 0xffffffffu : (1u << n) - 1;
+    if (shift_right) {
+      record_bits(s, osr & mask, n);
+      osr = n == 32 ? 0 : osr >> n;
+    } else {
+      record_bits(s, (n == 32 ? osr : osr >> (32 - n)) & mask, n);
+      osr = n == 32 ? 0 : osr << n;
+    }
+  }
+  pio->txf[sm] = data;
+  s->busy_until += word_us(s);
+  uint64_t done = (uint64_t)ceil(s->busy_until);
+  sim_hw_unlock();
+  return done;
+}
+
+static bool find_offset(uint p, const pio_program_t *program, uint *offset) {
+  uint32_t mask = (program->length >= 32 ? 0xffffffffu : (1u << program->length) - 1);
+  if (program->origin >= 0) {
+    *offset = (uint)program->origin;
+    return program->origin + program->length <= PIO_INSTRUCTION_COUNT &&
+           !(used_instructions[p] & (mask << program->origin));
+  }
+  // like the SDK, fill from the top of instruction memory down
+  for (int o = PIO_INSTRUCTION_COUNT - program->length; o >= 0; o--) {
+    if (!(used_instructions[p] & (mask << o))) {
+      *offset = (uint)o;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool pio_can_add_program(PIO pio, const pio_program_t *program) {
+  uint offset;
+  sim_hw_lock();
+  bool ok = find_offset(pio_get_index(pio), program, &offset);
+  sim_hw_unlock();
+  return ok;
+}
+
+uint pio_add_program(PIO pio, const pio_program_t *program) {
+  uint p = pio_get_index(pio);
+  uint offset;
+  sim_hw_lock();
+  if (!find_offset(p, program, &offset)) {
+    fprintf(stderr, "pico_sim: no program space on pio%u\n", p);
+    abort();
+  }
+  for (uint i = 0; i < program->length; i++) {
+    used_instructions[p] |= 1u << (offset + i);
+    out_bits_at[p][offset + i] = program->out_bits;
+  }
+  sim_hw_unlock();
+  return offset;
+}
+
+void pio_remove_program(PIO pio, const pio_program_t *program, uint loaded_offset) {
+  uint p = pio_get_index(pio);
+  sim_hw_lock();
+  for (uint i = 0; i < program->length; i++) {
+    used_instructions[p] &= ~(1u << (loaded_offset + i));
+  }
+  sim_hw_unlock();
+}
+
+void pio_sm_claim(PIO pio, uint sm) {
+  sim_hw_lock();
+  sm_t *s = &sms[pio_get_index(pio)][sm];
+  if (s->claimed) {
+    fprintf(stderr, "pico_sim: pio%u sm%u is already claimed\n", pio_get_index(pio), sm);
+    abort();
+  }
+  s->claimed = true;
+  sim_hw_unlock();
+}
+
+int pio_claim_unused_sm(PIO pio, bool required) {
+  int result = -1;
+  sim_hw_lock();
+  for (uint sm = 0; sm < NUM_PIO_STATE_MACHINES; sm++) {
+    if (!sms[pio_get_index(pio)][sm].claimed) {
+      pio_sm_claim(pio, sm);
+      result = (int)sm;
+      break;
+    }
+  }
+  sim_hw_unlock();
+  if (result < 0 && required) {
+    fprintf(stderr, "pico_sim: no state machines are available on pio%u\n", pio_get_index(pio));
+    abort();
+  }
+  return result;
+}
+
+void pio_sm_unclaim(PIO pio, uint sm) {
+  sim_hw_lock();
+  sms[pio_get_index(pio)][sm].claimed = false;
+  sim_hw_unlock();
+}
+
+void pio_gpio_init(PIO pio, uint pin) {
+}
+
+int pio_sm_set_consecutive_pindirs(PIO pio, uint sm, uint pin_base, uint pin_count, bool is_out) {
+  return 0;
+}
+
+void pio_sm_set_config(PIO pio, uint sm, const pio_sm_config *config) {
+  sim_hw_lock();
+  sms[pio_get_index(pio)][sm].config = *config;
+  sim_hw_unlock();
+}
+
+void pio_sm_init(PIO pio, uint sm, uint initial_pc, const pio_sm_config *config) {
+  uint p = pio_get_index(pio);
+  sm_t *s = &sms[p][sm];
+  sim_hw_lock();
+  flush_burst(p, sm);
+  s->enabled = false;
+  s->config = config ? *config : pio_get_default_sm_config();
+  s->out_bits = out_bits_at[p][initial_pc % PIO_INSTRUCTION_COUNT];
+  if (s->out_bits == 0) s->out_bits = 1;
+  s->busy_until = 0;
+  sim_hw_unlock();
+}
+
+void pio_sm_set_enabled(PIO pio, uint sm, bool enabled) {
+  sim_hw_lock();
+  sms[pio_get_index(pio)][sm].enabled = enabled;
+  sim_hw_unlock();
+}
+
+void pio_sm_set_clkdiv_int_frac(PIO pio, uint sm, uint16_t div_int, uint8_t div_frac) {
+  sim_hw_lock();
+  sm_config_set_clkdiv_int_frac(&sms[pio_get_index(pio)][sm].config, div_int, div_frac);
+  sim_hw_unlock();
+}
+
+void pio_sm_set_clkdiv(PIO pio, uint sm, float div) {
+  sim_hw_lock();
+  sm_config_set_clkdiv(&sms[pio_get_index(pio)][sm].config, div);
+  sim_hw_unlock();
+}
+
+void pio_sm_put(PIO pio, uint sm, uint32_t data) {
+  sim_pio_push(pio, sm, data, sim_now_us());
+}
+
+void pio_sm_put_blocking(PIO pio, uint sm, uint32_t data) {
+  sm_t *s = &sms[pio_get_index(pio)][sm];
+  sim_hw_lock();
+  double space_at = s->busy_until - fifo_depth(s) * word_us(s);
+  sim_hw_unlock();
+  if (space_at > 0) sleep_until((uint64_t)ceil(space_at));
+  sim_pio_push(pio, sm, data, sim_now_us());
+}
+
+uint pio_sm_get_tx_fifo_level(PIO pio, uint sm) {
+  sm_t *s = &sms[pio_get_index(pio)][sm];
+  sim_hw_lock();
+  // the word being shifted out has already left the FIFO
+  double queued = ceil((s->busy_until - (double)sim_now_us()) / word_us(s)) - 1;
+  uint level = queued <= 0 ? 0 : queued >= fifo_depth(s) ? fifo_depth(s) : (uint)queued;
+  sim_hw_unlock();
+  return level;
+}
+
+bool pio_sm_is_tx_fifo_empty(PIO pio, uint sm) {
+  return pio_sm_get_tx_fifo_level(pio, sm) == 0;
+}
+
+bool pio_sm_is_tx_fifo_full(PIO pio, uint sm) {
+  sm_t *s = &sms[pio_get_index(pio)][sm];
+  return pio_sm_get_tx_fifo_level(pio, sm) >= fifo_depth(s);
+}
+
+void pio_sm_clear_fifos(PIO pio, uint sm) {
+  sm_t *s = &sms[pio_get_index(pio)][sm];
+  sim_hw_lock();
+  double now = (double)sim_now_us();
+  if (s->busy_until > now) s->busy_until = now;
+  sim_hw_unlock();
+}
@@ -0,0 +1,85 @@
+// Shared state between the simulated peripherals. Not part of the SDK API.
+
+#pragma once
+
+#include "pico.h"
+#include "hardware/pio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ---- Virtual clock and events (clock.c) ----
+
+// Microseconds since boot: host monotonic time plus every jump made by
+// sim_wait_until()
+uint64_t sim_now_us(void);
+
+// Jumps the virtual clock forward to t if it is behind, then returns once
+// every event due by t has run. Does not wait for events when called from
+// the event thread or with interrupts disabled (see sim_events_blocked()).
+void sim_wait_until(uint64_t t);
+
+// Events stand in for hardware that completes on its own (DMA, alarms).
+// They fire in time order on a single event thread, with interrupts
+// disabled, so their callbacks can raise IRQs. An event must be embedded at
+// the start of the structure it belongs to.
+typedef struct sim_event sim_event_t;
+typedef void (*sim_event_fn)(sim_event_t *e);
+
+struct sim_event {
+  uint64_t when;
+  sim_event_fn fire;
+  sim_event_t *next;
+  bool queued;
+};
+
+void sim_event_schedule(sim_event_t *e, uint64_t when);
+void sim_event_cancel(sim_event_t *e);
+
+// True when events can't run until the caller returns
+bool sim_events_blocked(void);
+
+// ---- Peripheral state (one lock for all of it) ----
+
+void sim_hw_lock(void);
+void sim_hw_unlock(void);
+
+// ---- Interrupts (irq.c) ----
+
+// Calls the handlers for num if it is enabled. Returns false if nothing
+// handled it.
+bool sim_irq_raise(uint num);
+
+// ---- ADC (adc.c) ----
+
+bool sim_adc_is_fifo(const volatile void *addr);
+
+// Reserves the next n conversions for a reader of the FIFO. Returns the
+// virtual time the last of them completes, or UINT64_MAX while the ADC is
+// stopped. If first is not NULL it is set to the time the first of them
+// completes; the rest follow one every sim_adc_period_us().
+uint64_t sim_adc_claim(uint32_t n, double *first);
+
+double sim_adc_period_us(void);
+
+// Converts the next sample on the current input and returns it as the FIFO
+// would hold it. Exits the program once the input file runs out.
+uint16_t sim_adc_convert(void);
+
+// ---- DMA (dma.c) ----
+
+// The ADC started running; transfers waiting for it get their timing
+void sim_dma_adc_started(void);
+
+// ---- PIO (pio.c) ----
+
+bool sim_pio_find_txf(const volatile void *addr, PIO *pio, uint *sm);
+
+// Queues a word in the TX FIFO at virtual time now and returns the time the
+// state machine has finished shifting it out
+uint64_t sim_pio_push(PIO pio, uint sm, uint32_t data, uint64_t now);
+
+#ifdef __cplusplus
+}
+#endif
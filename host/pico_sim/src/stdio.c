@@ -0,0 +1,40 @@
+// stdio on the host's stdin/stdout.
+
+#include <poll.h>
+#include <unistd.h>
+
+#include "pico/stdio.h"
+#include "pico/stdio_usb.h"
+
+bool stdio_init_all(void) {
+  return true;
+}
+
+bool stdio_usb_init(void) {
+  return true;
+}
+
+bool stdio_usb_connected(void) {
+  return true;
+}
+
+void stdio_flush(void) {
+  fflush(stdout);
+}
+
+int getchar_timeout_us(uint32_t timeout_us) {
+  struct pollfd pfd = { STDIN_FILENO, POLLIN, 0 };
+  unsigned char c;
+  if (poll(&pfd, 1, (int)((timeout_us + 999) / 1000)) <= 0) return PICO_ERROR_TIMEOUT;
+  // at end of input there is nothing more to wait for, as with no host
+  if (read(STDIN_FILENO, &c, 1) != 1) return PICO_ERROR_TIMEOUT;
+  return c;
+}
+
+int putchar_raw(int c) {
+  return putchar(c);
+}
+
+int puts_raw(const char *s) {
+  return puts(s);
+}
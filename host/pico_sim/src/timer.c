@@ -0,0 +1,117 @@
+// Alarms and repeating timers, run as events on the virtual clock.
+
+#include "sim.h"
+#include "pico/time.h"
+
+#define MAX_TIMERS 16
+
+// All pools share one table; pools only exist so the API matches
+struct alarm_pool {
+  uint hardware_alarm_num;
+};
+
+typedef struct {
+  sim_event_t ev;
+  bool used;
+  alarm_callback_t callback;
+  void *user_data;
+  repeating_timer_t *rt;
+} timer_slot_t;
+
+static timer_slot_t timers[MAX_TIMERS];
+static alarm_pool_t default_pool = { 3 };
+static alarm_pool_t pools[4];
+
+static void timer_fire(sim_event_t *e) {
+  timer_slot_t *t = (timer_slot_t *)e;
+  alarm_id_t id = (alarm_id_t)(t - timers) + 1;
+
+  int64_t again;
+  if (t->rt) {
+    again = t->rt->callback(t->rt) ? t->rt->delay_us : 0;
+  } else {
+    again = t->callback(id, t->user_data);
+  }
+
+  sim_hw_lock();
+  if (t->used && again == 0) {
+    t->used = false;
+  } else if (t->used) {
+    // negative: relative to when this one was due, positive: to now
+    uint64_t next = again < 0 ? e->when + (uint64_t)(-again)
+                              : sim_now_us() + (uint64_t)again;
+    sim_event_schedule(e, next);
+  }
+  sim_hw_unlock();
+}
+
+static alarm_id_t timer_add(uint64_t when, alarm_callback_t callback,
+                            void *user_data, repeating_timer_t *rt) {
+  alarm_id_t id = -1;
+  sim_hw_lock();
+  for (int i = 0; i < MAX_TIMERS; i++) {
+    if (!timers[i].used) {
+      timer_slot_t *t = &timers[i];
+      t->used = true;
+      t->callback = callback;
+      t->user_data = user_data;
+      t->rt = rt;
+      t->ev.fire = timer_fire;
+      id = i + 1;
+      if (rt) rt->alarm_id = id;
+      sim_event_schedule(&t->ev, when);
+      break;
+    }
+  }
+  sim_hw_unlock();
+  return id;
+}
+
+static bool timer_cancel(alarm_id_t id) {
+  if (id < 1 || id > MAX_TIMERS) return false;
+  timer_slot_t *t = &timers[id - 1];
+  sim_hw_lock();
+  bool was_used = t->used;
+  t->used = false;
+  sim_event_cancel(&t->ev);
+  sim_hw_unlock();
+  return was_used;
+}
+
+alarm_pool_t *alarm_pool_get_default(void) {
+  return &default_pool;
+}
+
+alarm_pool_t *alarm_pool_create(uint hardware_alarm_num, uint max_timers) {
+  alarm_pool_t *pool = &pools[hardware_alarm_num & 3];
+  pool->hardware_alarm_num = hardware_alarm_num;
+  return pool;
+}
+
+alarm_id_t alarm_pool_add_alarm_in_us(alarm_pool_t *pool, uint64_t us,
+                                      alarm_callback_t callback,
+                                      void *user_data, bool fire_if_past) {
+  return timer_add(delayed_by_us(sim_now_us(), us), callback, user_data, NULL);
+}
+
+bool alarm_pool_cancel_alarm(alarm_pool_t *pool, alarm_id_t alarm_id) {
+  return timer_cancel(alarm_id);
+}
+
+bool alarm_pool_add_repeating_timer_us(alarm_pool_t *pool, int64_t delay_us,
+                                       repeating_timer_callback_t callback,
+                                       void *user_data, repeating_timer_t *out) {
+  if (delay_us == 0) delay_us = 1;
+  out->pool = pool;
+  out->callback = callback;
+  out->delay_us = delay_us;
+  out->user_data = user_data;
+  uint64_t first = sim_now_us() + (uint64_t)(delay_us < 0 ? -delay_us : delay_us);
+  return timer_add(first, NULL, user_data, out) > 0;
+}
+
+bool cancel_repeating_timer(repeating_timer_t *timer) {
+  bool cancelled = timer->alarm_id > 0 && timer_cancel(timer->alarm_id);
+  timer->alarm_id = 0;
+  return cancelled;
+}
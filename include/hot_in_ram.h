@@ -0,0 +1,22 @@
+// Code and data placement for the HOT_IN_RAM option of the programs in
+// this repository.
+//
+// Code on the Pico runs from flash through the 16 kB XIP cache, and a
+// miss stalls the core while the line is fetched over QSPI. Everything
+// else the program runs, the model above all, competes for that cache.
+// With HOT_IN_RAM the code run on every buffer or frame, and the tables
+// it reads, are copied to SRAM at boot so they never wait on flash.
+// Without it both macros leave the placement to the linker.
+
+#pragma once
+
+#if HOT_IN_RAM
+#include "pico/platform.h"
+// a function run from SRAM, never inlined into a caller left in flash
+#define HOT_FUNC(func) __no_inline_not_in_flash_func(func)
+// a variable or table in SRAM, in the named section group
+#define HOT_DATA(group) __not_in_flash(group)
+#else
+#define HOT_FUNC(func) func
+#define HOT_DATA(group)
+#endif
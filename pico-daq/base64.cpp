@@ -26,6 +26,10 @@
 */
 
 #include "base64.h"
+#include "hot_in_ram.h"
+
+// Only the encoder needs placing for HOT_IN_RAM: its table is a
+// std::string, so it is on the heap already.
 
 static const std::string base64_chars =
   "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
@@ -37,7 +41,7 @@ static inline bool is_base64(unsigned char c) {
   return (isalnum(c) || (c == '+') || (c == '/'));
 }
 
-std::string base64_encode(unsigned char const* bytes_to_encode, unsigned int in_len) {
+std::string HOT_FUNC(base64_encode)(unsigned char const* bytes_to_encode, unsigned int in_len) {
   std::string ret;
   int i = 0;
   int j = 0;
@@ -8,7 +8,10 @@
 #include "pico/stdlib.h"
 #include "hardware/adc.h"
 #include "hardware/dma.h"
+#include "hardware/irq.h"
 #include "base64.h"
+#include "block_desc.h"
+#include "scale.h"
 
 // set this to determine sample rate
 // 0     = 500,000 Hz
@@ -16,23 +19,68 @@
 // 9600  = 5,000 Hz
 #define CLOCK_DIV 12000
 
-// Channel 0 is GPIO26
-#define CAPTURE_CHANNEL 0
+// ADC inputs to capture, one bit each: bits 0-3 are GPIO26-29 and
+// bit 4 is the internal temperature sensor. With more than one input
+// the ADC converts them in turn (round robin) and the DMA stores the
+// samples interleaved, lowest input first. The rate set by CLOCK_DIV
+// is shared between the inputs.
+#define CAPTURE_MASK 0x01
 #define LED_PIN 25
 #define NSAMP 10000
 
+constexpr uint count_inputs(uint mask) {
+  return mask ? (mask & 1) + count_inputs(mask >> 1) : 0;
+}
+
+#define NUM_CHANNELS count_inputs(CAPTURE_MASK)
+#define FIRST_INPUT __builtin_ctz(CAPTURE_MASK)
+// whole frames of one sample per channel
+#define NSAMP_CHANNEL (NSAMP / NUM_CHANNELS)
+#define NSAMP_FRAMES (NSAMP_CHANNEL * NUM_CHANNELS)
+
+// A conversion takes 96 ADC clocks; slower rates start one every
+// CLOCK_DIV+1 clocks
+#define SAMPLE_RATE (48000000.0f / (CLOCK_DIV < 96 ? 96 : CLOCK_DIV + 1))
+#define CHANNEL_RATE (SAMPLE_RATE / NUM_CHANNELS)
+
+static_assert(CAPTURE_MASK > 0 && CAPTURE_MASK < (1 << 5),
+              "CAPTURE_MASK selects ADC inputs 0-4");
+
+// Channel k of an interleaved capture
+template <typename T> strided<T> channel(T *buf, uint k) {
+  return strided<T>{buf + k, NUM_CHANNELS};
+}
+
 uint16_t capture_buf[NSAMP];
 float sending_buf[NSAMP];
+uint channel_input[NUM_CHANNELS];
+
+uint dma_chan;
+
+#if TRIGGERED_CAPTURE
+void scope();
+#endif
+
+void dma_handler() {
+  dma_channel_acknowledge_irq0(dma_chan);
+  block_completed(NSAMP_FRAMES);
+}
 
 int main() {
     stdio_init_all();
 
     gpio_init(LED_PIN);
     gpio_set_dir(LED_PIN, GPIO_OUT);
-    adc_gpio_init(26 + CAPTURE_CHANNEL);
 
     adc_init();
-    adc_select_input(CAPTURE_CHANNEL);
+    for (uint input = 0, k = 0; input < 5; input++) {
+      if (!(CAPTURE_MASK & (1 << input))) continue;
+      if (input < 4) adc_gpio_init(26 + input);
+      else adc_set_temp_sensor_enabled(true);
+      channel_input[k++] = input;
+    }
+    adc_select_input(FIRST_INPUT);
+    adc_set_round_robin(NUM_CHANNELS > 1 ? CAPTURE_MASK : 0);
     adc_fifo_setup(
         true,    // Write each completed conversion to the sample FIFO
         true,    // Enable DMA data request (DREQ)
@@ -46,7 +94,7 @@ int main() {
 
     sleep_ms(1000);
     // Set up the DMA to start transferring data as soon as it appears in FIFO
-    uint dma_chan = dma_claim_unused_channel(true);
+    dma_chan = dma_claim_unused_channel(true);
     dma_channel_config cfg = dma_channel_get_default_config(dma_chan);
 
     // Reading from constant address, writing to incrementing byte addresses
@@ -56,15 +104,30 @@ int main() {
 
     // Pace transfers based on availability of ADC samples
     channel_config_set_dreq(&cfg, DREQ_ADC);
+
+#if TRIGGERED_CAPTURE
+    scope();
+#endif
+
+    dma_channel_set_irq0_enabled(dma_chan, true);
+    irq_set_exclusive_handler(DMA_IRQ_0, dma_handler);
+    irq_set_enabled(DMA_IRQ_0, true);
+
+    // descriptor of the block in sending_buf; none until one is captured
+    block_desc sending = {0, 0, 0};
     
     while (1) {
-      adc_fifo_drain();
+      // stop first so the conversion in progress lands before the drain,
+      // then restart the round robin at the first input so each DMA
+      // buffer begins on channel 0
       adc_run(false);
+      adc_fifo_drain();
+      adc_select_input(FIRST_INPUT);
       
       dma_channel_configure(dma_chan, &cfg,
         capture_buf,    // dst
         &adc_hw->fifo,  // src
-        NSAMP,          // transfer count
+        NSAMP_FRAMES,   // transfer count
         true            // start immediately
       );
 
@@ -77,26 +140,205 @@ int main() {
       gpio_put(LED_PIN, 1);
       adc_run(true);
 
-      // first transmission will be garbage since we haven't filled buf
-      std::string encoded =
-	base64_encode((unsigned char const *)sending_buf, NSAMP*4);
-      
-      printf("%s", encoded.c_str());
+      // each block goes on its own line, after a line describing it:
+      //   #B <timestamp us> <first sample> <count>
+      if (sending.count) {
+	std::string encoded =
+	  base64_encode((unsigned char const *)sending_buf, sending.count*4);
+
+	printf("#B %llu %llu %lu\n%s\n",
+	       (unsigned long long)sending.timestamp_us,
+	       (unsigned long long)sending.first_sample,
+	       (unsigned long)sending.count,
+	       encoded.c_str());
+      }
 
       gpio_put(LED_PIN, 0);
 
       dma_channel_wait_for_finish_blocking(dma_chan);
+      sending = block_latest();
+
+      // each channel is scaled on its own, in place in the interleaved
+      // buffers. The temperature sensor keeps its absolute value: the
+      // 12-bit code is mapped to [-1, 1] so it can be turned back into
+      // a voltage (see py/b64_float_to_wave.py)
+      for (uint k=0; k<NUM_CHANNELS; k++) {
+	strided<uint16_t> in = channel(capture_buf, k);
+	strided<float> out = channel(sending_buf, k);
 
-      uint16_t min = 32768;
-      uint16_t max = 0;
-	
-      for (uint32_t i=0; i<NSAMP; i++) {
-	if (capture_buf[i] > max) max = capture_buf[i];
-	if (capture_buf[i] < min) min = capture_buf[i];
+	if (channel_input[k] == 4) {
+	  for (uint32_t i=0; i<NSAMP_CHANNEL; i++) {
+	    out[i] = (float)in[i]/2048-1;
+	  }
+	  continue;
+	}
+
+	scale_channel(in, out, NSAMP_CHANNEL);
       }
-	    
-      for (uint32_t i=0; i<NSAMP; i++) {
-	sending_buf[i] = ((float)capture_buf[i]-(float)min)/((float)max-(float)min)*2-1;
+    }
+}
+
+#if TRIGGERED_CAPTURE
+// ############ Triggered capture ############
+//
+// Rather than streaming every sample, the ADC runs without a break into
+// a DMA ring and only a window around each trigger is sent, as an
+// oscilloscope would. The ring always holds the last RING_SAMPLES, so
+// the window can start before the trigger. Samples are scanned two at a
+// time, one per 16-bit half of a word, and most words are passed over
+// with a couple of word-wide operations, which keeps up with 500 kS/s.
+//
+// Each window is sent as two lines:
+//   #T <timestamp us> <trigger sample> <pre> <post>
+//   <base64 of pre+post 12-bit samples, uint16 little endian>
+
+#define TRIG_LEVEL 0   // any sample at or above TRIGGER_THRESHOLD
+#define TRIG_RISING 1  // crossing up through TRIGGER_THRESHOLD
+#define TRIG_FALLING 2 // crossing down through TRIGGER_THRESHOLD
+#define TRIG_SLOPE 3   // rising TRIGGER_SLOPE codes or more over two samples
+
+#define TRIGGER TRIG_RISING
+#define TRIGGER_THRESHOLD 2048
+#define TRIGGER_SLOPE 200
+#define PRE_SAMPLES 1000
+#define POST_SAMPLES 3000
+// samples after a window before the trigger is armed again
+#define HOLDOFF_SAMPLES 10000
+
+// 2^RING_BITS bytes; the DMA write address wraps within it
+#define RING_BITS 15
+#define RING_SAMPLES (1 << (RING_BITS - 1))
+#define RING_WORDS (RING_SAMPLES / 2)
+
+static_assert(NUM_CHANNELS == 1, "triggered capture samples one input");
+static_assert(PRE_SAMPLES + POST_SAMPLES <= RING_SAMPLES / 2,
+	      "the window must fit in half the ring");
+static_assert(!(PRE_SAMPLES & 1), "PRE_SAMPLES must be even");
+
+uint16_t ring[RING_SAMPLES] __attribute__((aligned(1 << RING_BITS)));
+uint16_t window[PRE_SAMPLES + POST_SAMPLES];
+
+// Each 16-bit lane holds a 12-bit sample, so setting the lane's top bit
+// and subtracting can never borrow from the next lane. The top bit is
+// left set in lanes where the sample was at least the subtrahend.
+#define LANE_TOP 0x80008000u
+#define LANES(x) ((uint32_t)(x) * 0x00010001u)
+
+static inline uint32_t lanes_at_least(uint32_t w, uint32_t lanes) {
+  return ((w | LANE_TOP) - lanes) & LANE_TOP;
+}
+
+// true while the signal is on the triggered side of the threshold; an
+// edge trigger has to see the other side first, which arms it
+static bool past_threshold;
+
+// Returns the first trigger in samples [from, to), or to if there is
+// none. Both are even, so every step is a whole word.
+static uint64_t scan(uint64_t from, uint64_t to) {
+  const uint32_t *words = (const uint32_t *)ring;
+
+  for (uint64_t i = from; i < to; i += 2) {
+    uint32_t w = words[(i / 2) % RING_WORDS];
+#if TRIGGER == TRIG_SLOPE
+    uint32_t before = words[(i / 2 - 1) % RING_WORDS];
+    uint32_t hit = (((w | LANE_TOP) - before) - LANES(TRIGGER_SLOPE)) & LANE_TOP;
+#else
+    uint32_t hit = lanes_at_least(w, LANES(TRIGGER_THRESHOLD));
+#if TRIGGER == TRIG_FALLING
+    hit ^= LANE_TOP;
+#endif
+#if TRIGGER != TRIG_LEVEL
+    // nothing to do unless a lane is on the other side from the last
+    if (hit == (past_threshold ? LANE_TOP : 0)) continue;
+    // the first sample is the low half
+    for (uint lane = 0; lane < 2; lane++) {
+      bool past = hit & (0x8000u << (16 * lane));
+      if (past && !past_threshold) {
+	past_threshold = true;
+	return i + lane;
       }
+      past_threshold = past;
+    }
+    continue;
+#endif
+#endif
+    if (hit) return i + ((hit & 0x8000) ? 0 : 1);
+  }
+  return to;
+}
+
+void scope() {
+  dma_channel_config c = dma_channel_get_default_config(dma_chan);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_16);
+  channel_config_set_read_increment(&c, false);
+  channel_config_set_write_increment(&c, true);
+  channel_config_set_dreq(&c, DREQ_ADC);
+  channel_config_set_ring(&c, true, RING_BITS);
+
+  // the longest transfer there is; at 500 kS/s it runs for 2.4 hours
+  // before it is restarted
+  const uint32_t run = 0xffffffff;
+  adc_run(false);
+  adc_fifo_drain();
+  dma_channel_configure(dma_chan, &c, ring, &adc_hw->fifo, run, true);
+  adc_run(true);
+
+  uint64_t base = 0;             // samples written by earlier transfers
+  uint64_t pos = PRE_SAMPLES;    // next sample to scan
+  uint32_t lost = 0;             // times the scan fell a ring behind
+  past_threshold = true;
+
+  while (1) {
+    if (!dma_channel_is_busy(dma_chan)) {
+      base += run;
+      dma_channel_set_trans_count(dma_chan, run, true);
+    }
+    uint64_t written = base + (run - dma_hw->ch[dma_chan].transfer_count);
+
+    // the oldest samples not yet scanned have been written over
+    if (written > pos && written - pos > RING_SAMPLES - PRE_SAMPLES) {
+      pos = (written - RING_SAMPLES / 2) & ~1ull;
+      past_threshold = true;
+      lost++;
+    }
+
+    uint64_t to = written & ~1ull;
+    if (to <= pos) {
+      sleep_us(100);
+      continue;
+    }
+    uint64_t t = scan(pos, to);
+    if (t == to) {
+      pos = to;
+      continue;
     }
+
+    // wait for the rest of the window, then copy it out of the ring
+    // before it is written over
+    while (written < t + POST_SAMPLES) {
+      sleep_us(100);
+      written = base + (run - dma_hw->ch[dma_chan].transfer_count);
+    }
+    uint64_t now = time_us_64();
+    for (uint i = 0; i < PRE_SAMPLES + POST_SAMPLES; i++) {
+      window[i] = ring[(t - PRE_SAMPLES + i) % RING_SAMPLES];
+    }
+    uint64_t stamp = now - (uint64_t)((written - t) * 1e6 / SAMPLE_RATE);
+
+    gpio_put(LED_PIN, 1);
+    std::string encoded =
+      base64_encode((unsigned char const *)window, sizeof(window));
+    printf("#T %llu %llu %d %d\n%s\n", (unsigned long long)stamp,
+	   (unsigned long long)t, PRE_SAMPLES, POST_SAMPLES, encoded.c_str());
+    if (lost) {
+      printf("#L %lu\n", (unsigned long)lost);
+      lost = 0;
+    }
+    gpio_put(LED_PIN, 0);
+
+    // re-arm after the holdoff
+    pos = (t + POST_SAMPLES + HOLDOFF_SAMPLES + 1) & ~1ull;
+    past_threshold = true;
+  }
 }
+#endif
@@ -8,17 +8,44 @@ if __name__=="__main__":
     infile = "/Users/alex/Desktop/float-test/stop-2"
     outfile = "/Users/alex/Desktop/float-test/stop.wav"
 
+    # Must match CAPTURE_MASK and CLOCK_DIV in pico_daq.cpp. Samples
+    # arrive interleaved, one per captured input in turn, and each
+    # input becomes a channel of the WAV file. Bit 4 is the
+    # temperature sensor, which is printed instead.
+    capture_mask = 0x01
+    clock_div = 12000
+    inputs = [i for i in range(5) if capture_mask & (1 << i)]
+    rate = 48000000 / max(96, clock_div + 1) / len(inputs)
+
     f = open(infile, "r")
 
+    # Each block is a "#B <timestamp us> <first sample> <count>" line
+    # followed by a line of base64
+    blocks = []
     byte_data = bytearray()
-    vals = f.read(1000)
-    # Reading all at once didn't work for some reason
-    while vals:
-        byte_data.extend(base64.b64decode(vals))
-        vals = f.read(1000)
-        if len(vals) != 1000: break
+    for line in f:
+        line = line.strip()
+        if line.startswith("#B"):
+            blocks.append([int(v) for v in line.split()[1:4]])
+            continue
+        # whole 4-character groups only; a lost character spoils the
+        # rest of its own line but not the lines after it
+        try:
+            byte_data.extend(base64.b64decode(line[:len(line)//4*4]))
+        except ValueError:
+            print("Skipped a damaged block")
     f.close()
 
+    # The timestamps are taken as each block finishes, so the time
+    # between two blocks beyond the second one's length went unrecorded
+    lost = 0
+    for prev, cur in zip(blocks, blocks[1:]):
+        lost += (cur[0] - prev[0]) / 1e6 - cur[2] / (rate * len(inputs))
+    if len(blocks) > 1:
+        span = (blocks[-1][0] - blocks[0][0]) / 1e6
+        print("%d blocks over %0.1f s, %0.2f s not recorded" %
+              (len(blocks), span, lost))
+
     # Enforce little endian
     dt = np.dtype(np.float32)
     dt = dt.newbyteorder('<')
@@ -42,8 +69,21 @@ if __name__=="__main__":
             num_idx = num_idx+1
             byte_idx = byte_idx + 4
     
+    # whole frames only; a lost sample shifts the channels after it
+    data = data[:num_idx - num_idx % len(inputs)]
+    data = data.reshape(-1, len(inputs))
+
+    if 4 in inputs:
+        # sent as code/2048-1; 0.706 V at 27 C, falling 1.721 mV per C
+        volts = (data[:, inputs.index(4)] + 1) * 2048 * 3.3 / 4096
+        temps = 27 - (volts - 0.706) / 0.001721
+        print("Temperature: %0.1f C (%0.1f to %0.1f)" %
+              (np.mean(temps), np.min(temps), np.max(temps)))
+        data = np.delete(data, inputs.index(4), axis=1)
+        if data.shape[1] == 0: exit()
+
     wav_io = io.BytesIO()
-    scipy.io.wavfile.write(wav_io, 4000, data)
+    scipy.io.wavfile.write(wav_io, int(round(rate)), data)
     wav_io.seek(0)
     sound = AudioSegment.from_wav(wav_io)
         
@@ -0,0 +1,47 @@
+import matplotlib.pyplot as plt
+import numpy as np
+import base64
+
+# Reads the output of pico_daq built with TRIGGERED_CAPTURE and plots
+# every captured window on top of each other, lined up on the trigger
+if __name__=="__main__":
+    infile = "/Users/alex/Desktop/scope/screenlog.0"
+
+    # Must match CLOCK_DIV in pico_daq.cpp
+    clock_div = 0
+    rate = 48000000 / max(96, clock_div + 1)
+
+    f = open(infile, "r")
+    lines = [line.strip() for line in f]
+    f.close()
+
+    # Enforce little endian
+    dt = np.dtype(np.uint16)
+    dt = dt.newbyteorder('<')
+
+    windows = 0
+    for header, data in zip(lines, lines[1:]):
+        if header.startswith("#L"):
+            print("Missed triggers: scan fell behind %s times" % header.split()[1])
+        if not header.startswith("#T"):
+            continue
+        stamp, trigger, pre, post = [int(v) for v in header.split()[1:5]]
+        try:
+            samples = np.frombuffer(base64.b64decode(data), dtype=dt)
+        except ValueError:
+            print("Skipped a damaged window")
+            continue
+        if len(samples) != pre + post:
+            print("Skipped a short window")
+            continue
+
+        t = (np.arange(pre + post) - pre) / rate * 1000
+        plt.plot(t, samples, linewidth=0.5)
+        print("Trigger at sample %d, %0.6f s" % (trigger, stamp / 1e6))
+        windows += 1
+
+    plt.axvline(0, color="k", linewidth=0.5)
+    plt.xlabel("Time from trigger (ms)")
+    plt.ylabel("ADC code")
+    plt.title("%d triggers" % windows)
+    plt.show()
@@ -0,0 +1,16 @@
+#include "scale.h"
+#include "hot_in_ram.h"
+
+void HOT_FUNC(scale_channel)(strided<uint16_t> in, strided<float> out, uint32_t n) {
+  uint16_t min = 32768;
+  uint16_t max = 0;
+
+  for (uint32_t i=0; i<n; i++) {
+    if (in[i] > max) max = in[i];
+    if (in[i] < min) min = in[i];
+  }
+
+  for (uint32_t i=0; i<n; i++) {
+    out[i] = ((float)in[i]-(float)min)/((float)max-(float)min)*2-1;
+  }
+}
@@ -0,0 +1,14 @@
+// Scaling of captured ADC codes to the floats pico-daq sends
+
+#pragma once
+#include "pico/types.h"
+
+// One channel of an interleaved buffer, read in place
+template <typename T> struct strided {
+  T *first;
+  uint stride;
+  T &operator[](uint i) const { return first[i * stride]; }
+};
+
+// Scales n samples of one channel to [-1, 1] between its own min and max
+void scale_channel(strided<uint16_t> in, strided<float> out, uint32_t n);
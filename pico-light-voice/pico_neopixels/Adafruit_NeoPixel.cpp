@@ -47,6 +47,7 @@
 #include "pico/stdio.h"
 #include "pico/malloc.h"
 //#include "pico/mem_ops.h"
+#include "hardware/irq.h"
 #include <cstdlib>
 #include <cstring>
 #include <cstdio>
@@ -66,6 +67,46 @@
 #define PRINTF1(...)
 #endif
 
+// Bits the state machine pulls per FIFO word. The colour bytes are sent
+// as one continuous MSB-first stream, so packing four of them into each
+// word (byte-swapped into transmission order) gives one FIFO write per
+// RGBW pixel, or three per four RGB pixels, instead of one per byte.
+#define NEO_PIO_BITS 32
+
+// Pixel buffers are padded to whole words; the spare zero bytes are
+// clocked out past the last pixel, where they are ignored
+#define NEO_WORDS(bytes) (((bytes) + 3) / 4)
+
+// Time (in microseconds) for the words still sitting in the joined TX
+// FIFO and the output shift register to drain once the DMA transfer has
+// finished: 8 FIFO entries + OSR, at 1.25 or 2.5 us per bit
+#define NEO_FIFO_DRAIN_US(is800KHz) ((9 * NEO_PIO_BITS * ((is800KHz) ? 125 : 250) + 99) / 100)
+
+// Strip that owns each DMA channel, so the shared completion handler can
+// find the object whose frame has just been sent
+static Adafruit_NeoPixel *dma_strip[NUM_DMA_CHANNELS];
+static bool dma_irq_installed = false;
+
+// Pixel buffers come from a fixed pool instead of the heap, so their
+// footprint is known at link time. Allocations are handed out in order and
+// only the most recent one can be given back.
+static uint32_t neopixel_pool[NEOPIXEL_POOL_BYTES / 4];
+static uint32_t neopixel_pool_used = 0; // bytes
+
+uint8_t *neopixel_pool_alloc(uint32_t bytes) {
+  bytes = (bytes + 3) & ~3u;
+  if (neopixel_pool_used + bytes > sizeof(neopixel_pool)) return NULL;
+  uint8_t *p = (uint8_t *)neopixel_pool + neopixel_pool_used;
+  neopixel_pool_used += bytes;
+  return p;
+}
+
+void neopixel_pool_free(uint8_t *p, uint32_t bytes) {
+  bytes = (bytes + 3) & ~3u;
+  if (p != NULL && p + bytes == (uint8_t *)neopixel_pool + neopixel_pool_used)
+    neopixel_pool_used -= bytes;
+}
+
 
 /*!
   @brief   NeoPixel constructor when length, pin and pixel type are known
@@ -80,9 +121,10 @@
   @return  Adafruit_NeoPixel object. Call the begin() function before use.
 */
 Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, uint16_t p, neoPixelType t) :
-  begun(false), brightness(0), pixels(NULL), opixels(NULL), brightfr(NULL), brightfg(NULL), brightfb(NULL), brightfw(NULL)  {
+  begun(false), brightness(0), pixels(NULL), front(NULL), capacity(0), dirtyFirst(0), dirtyEnd(0), lut(NULL), lutSize(0), lutMode(NEO_LUT_NONE), gammaOn(false), frameSent(false), keepAliveUs(0), pixels16(NULL), ditherErr(NULL), ditherBytes(0), dma_chan(-1), showCallback(NULL), brightfr(NULL), brightfg(NULL), brightfb(NULL), brightfw(NULL)  {
   PRINTF1("In constructor 1\n");
-  endTime = get_absolute_time() ;
+  lastSent = get_absolute_time() ;
+  endTime = to_us_since_boot(lastSent) ;
   PRINTF1("In constructor 2\n");
   setPin(p);
   PRINTF1("In constructor 3\n");
@@ -106,8 +148,9 @@ Adafruit_NeoPixel::Adafruit_NeoPixel() :
 #if defined(NEO_KHZ400)
   is800KHz(true),
 #endif
-  begun(false), numLEDs(0), numBytes(0), pin(-1), brightness(0), pixels(NULL), opixels(NULL), brightfr(NULL), brightfg(NULL), brightfb(NULL), brightfw(NULL), rOffset(1), gOffset(0), bOffset(2), wOffset(1){
-  endTime = get_absolute_time();
+  begun(false), numLEDs(0), numBytes(0), pin(-1), brightness(0), pixels(NULL), front(NULL), capacity(0), dirtyFirst(0), dirtyEnd(0), lut(NULL), lutSize(0), lutMode(NEO_LUT_NONE), gammaOn(false), rOffset(1), gOffset(0), bOffset(2), wOffset(1), frameSent(false), keepAliveUs(0), pixels16(NULL), ditherErr(NULL), ditherBytes(0), dma_chan(-1), showCallback(NULL), brightfr(NULL), brightfg(NULL), brightfb(NULL), brightfw(NULL){
+  lastSent = get_absolute_time();
+  endTime = to_us_since_boot(lastSent);
 }
 
 /*!
@@ -115,13 +158,22 @@ Adafruit_NeoPixel::Adafruit_NeoPixel() :
 */
 Adafruit_NeoPixel::~Adafruit_NeoPixel() {
   PRINTF0("In destructor\n  ===>\n");
-  memset(pixels, 0, numBytes);
+  clear();
   show() ;
+  while (isShowing()) ;
   sleep_ms(20) ;
+  if (dma_chan >= 0) {
+	  dma_channel_set_irq1_enabled(dma_chan, false);
+	  dma_strip[dma_chan] = NULL;
+	  dma_channel_unclaim(dma_chan);
+	  dma_chan = -1;
+  };
   PRINTF1("End init = %d, pin = %d, 800kHz = %d, length = %d, pio= %d, sm = %d, offset = %d, no_sm = [%d, %d]\n ", begun, pin, is800KHz, numLEDs, pio_get_index(pio), sm, (pio_get_index(pio) == 0) ? pio0_offset : pio1_offset,pio_no_sm[0], pio_no_sm[1] );
   PRINTF1("going to free\n");
-  free(pixels);  // unclaim the memory for the pixels
-  free(opixels); // unclaim the memory for the pixels
+  // Pool memory is only returned when it is the most recent allocation,
+  // so give it back in the reverse order it was taken
+  releaseExtras();
+  neopixel_pool_free(pixels, 2 * capacity);  // unclaim the memory for the pixels
   PRINTF1("freed pixels\n");
   pio_sm_unclaim(pio,sm); // unclaim the state machine
   pio_no_sm[pio_get_index(pio)]-- ;
@@ -143,8 +195,10 @@ void Adafruit_NeoPixel::begin(void) {
 
 /*!
   @brief   Change the length of a previously-declared Adafruit_NeoPixel
-           strip object. Old data is deallocated and new data is cleared.
-           Pin number and pixel format are unchanged.
+           strip object. New data is cleared. The front and back buffers
+           are reused if they are big enough, otherwise new ones are taken
+           from the static pool (see NEOPIXEL_POOL_BYTES). Pin number and
+           pixel format are unchanged.
   @param   n  New length of strip, in pixels.
   @note    This function is deprecated, here only for old projects that
            may still be calling it. New projects should instead use the
@@ -152,27 +206,60 @@ void Adafruit_NeoPixel::begin(void) {
            type).
 */
 void Adafruit_NeoPixel::updateLength(uint16_t n) {
-  free(pixels); // Free existing data (if any)
+  // The front buffer may still be streaming out
+  while (isShowing()) ;
 
   // Allocate new data -- note: ALL PIXELS ARE CLEARED
   numBytes = n * ((wOffset == rOffset) ? 3 : 4);
-  if((pixels = (uint8_t *)malloc(numBytes))) {
-    memset(pixels, 0, numBytes);
+  uint16_t need = NEO_WORDS(numBytes) * 4;
+  // Dither buffers that are too small must be set up again with
+  // enableDithering(). They and the lookup table were taken from the pool
+  // after the pixels, so they are given back first for the pixel space to
+  // be reused, and the table is built again below.
+  bool released = (ditherErr && numBytes > ditherBytes) || need > capacity;
+  if (released) releaseExtras();
+  if (need > capacity) {
+    // Free existing data (if it can be)
+    neopixel_pool_free(pixels, 2 * capacity);
+    // Back and front buffers are allocated together
+    if((pixels = neopixel_pool_alloc(2 * need))) {
+      front = pixels + need;
+      capacity = need;
+    } else {
+      front = NULL;
+      capacity = 0;
+    }
+  }
+  if(pixels) {
+    memset(pixels, 0, capacity);
+    memset(front, 0, capacity);
     numLEDs = n;
   } else {
     numLEDs = numBytes = 0;
   }
-  
-  if (brightfr != NULL) {
-	  free(opixels) ;
-	  if((opixels = (uint8_t *)malloc(numBytes))) {
-			memset(opixels, 0, numBytes);
-			numLEDs = n;
-	  } else {
-			numLEDs = numBytes = 0;
-	  };
-  };
-  
+  markDirty(0, numLEDs);
+  // The strip still shows whatever it had before, which the cleared front
+  // buffer says nothing about, so the first frame always goes out
+  frameSent = false;
+  if (released) updateLut();
+}
+
+/*!
+  @brief   Give the dither buffers and the lookup table back to the pool.
+           The pool only takes back its latest allocation, so whichever
+           was taken last goes first.
+*/
+void Adafruit_NeoPixel::releaseExtras(void) {
+  uint8_t *dither = ditherErr ? ditherErr - 2 * ditherBytes : NULL;
+  if (lut > dither) neopixel_pool_free(lut, lutSize);
+  if (dither) neopixel_pool_free(dither, 3 * ditherBytes);
+  if (lut < dither) neopixel_pool_free(lut, lutSize);
+  pixels16 = NULL;
+  ditherErr = NULL;
+  ditherBytes = 0;
+  lut = NULL;
+  lutSize = 0;
+  lutMode = NEO_LUT_NONE;
 }
 
 /*!
@@ -194,6 +281,7 @@ void Adafruit_NeoPixel::updateLength(uint16_t n) {
 */
 void Adafruit_NeoPixel::updateType(neoPixelType t) {
   bool oldThreeBytesPerPixel = (wOffset == rOffset); // false if RGBW
+  uint8_t oldR = rOffset, oldG = gOffset, oldB = bOffset, oldW = wOffset;
 
   wOffset = (t >> 6) & 0b11; // See notes in header file
   rOffset = (t >> 4) & 0b11; // regarding R/G/B/W offsets
@@ -208,7 +296,12 @@ void Adafruit_NeoPixel::updateType(neoPixelType t) {
   if(pixels) {
     bool newThreeBytesPerPixel = (wOffset == rOffset);
     if(newThreeBytesPerPixel != oldThreeBytesPerPixel) updateLength(numLEDs);
+    markDirty(0, numLEDs);
   }
+
+  // Per-channel tables are laid out by byte position
+  if(lutMode == NEO_LUT_CHANNEL && (oldR != rOffset || oldG != gOffset ||
+                                    oldB != bOffset || oldW != wOffset)) updateLut();
 }
 
 
@@ -226,20 +319,30 @@ void Adafruit_NeoPixel::rp2040Init(uint8_t set_pin)
 			PRINTF1("canpio = %d\n",canpio);
 			if (canpio) pio0_offset = pio_add_program(pio0, &ws2812byte_program);
 		};
-		pio = pio0;
+		if (pio0_offset == -1) {
+			// no room for the program; give the state machine back
+			pio_sm_unclaim(pio0, resultsm);
+		} else {
+			pio = pio0;
+		};
 	};
 	if (resultsm == -1 || pio0_offset == -1) {
 		resultsm = pio_claim_unused_sm(pio1,false);
 		if (resultsm != -1) {
 			if (pio1_offset == -1) {
 				canpio = pio_can_add_program(pio1, &ws2812byte_program);
-				if (canpio) pio1_offset = pio_add_program(pio0, &ws2812byte_program);
+				if (canpio) pio1_offset = pio_add_program(pio1, &ws2812byte_program);
+			};
+			if (pio1_offset == -1) {
+				pio_sm_unclaim(pio1, resultsm);
+				resultsm = -1;
+			} else {
+				pio = pio1;
 			};
-			pio = pio1;
 		}
 	};
 	
-	if (resultsm == -1 || (pio0_offset == -1 && pio1_offset == -1)) {
+	if (resultsm == -1) {
 		sm = -1 ;
 		return ;
 	}
@@ -253,14 +356,38 @@ void Adafruit_NeoPixel::rp2040Init(uint8_t set_pin)
 	
     if (is800KHz)
     {
-        // 800kHz, 8 bit transfers
-        ws2812byte_program_init(pio, sm, (pio_get_index(pio) == 0) ? pio0_offset : pio1_offset, pin, 800000, 8);
+        // 800kHz, 32 bit transfers
+        ws2812byte_program_init(pio, sm, (pio_get_index(pio) == 0) ? pio0_offset : pio1_offset, pin, 800000, NEO_PIO_BITS);
     }
     else
     {
-        // 400kHz, 8 bit transfers
-        ws2812byte_program_init(pio, sm, (pio_get_index(pio) == 0) ? pio0_offset : pio1_offset, pin, 400000, 8);
+        // 400kHz, 32 bit transfers
+        ws2812byte_program_init(pio, sm, (pio_get_index(pio) == 0) ? pio0_offset : pio1_offset, pin, 400000, NEO_PIO_BITS);
     } ;
+
+	// Stream the pixel buffer into the TX FIFO with DMA, paced by the
+	// state machine's DREQ. If no channel is free show() falls back to
+	// feeding the FIFO from the CPU.
+	dma_chan = dma_claim_unused_channel(false);
+	if (dma_chan >= 0) {
+		dma_channel_config c = dma_channel_get_default_config(dma_chan);
+		// Whole words, byte-swapped so the first colour byte in memory
+		// ends up in the top 8 bits that the state machine shifts out first
+		channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+		channel_config_set_bswap(&c, true);
+		channel_config_set_read_increment(&c, true);
+		channel_config_set_write_increment(&c, false);
+		channel_config_set_dreq(&c, pio_get_dreq(pio, sm, true));
+		dma_channel_configure(dma_chan, &c, &pio->txf[sm], NULL, 0, false);
+
+		dma_strip[dma_chan] = this;
+		dma_channel_set_irq1_enabled(dma_chan, true);
+		if (!dma_irq_installed) {
+			irq_add_shared_handler(DMA_IRQ_1, rp2040DmaHandler, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+			irq_set_enabled(DMA_IRQ_1, true);
+			dma_irq_installed = true;
+		};
+	};
 	begun = true ;
 	PRINTF0("exit INIT pio %d, sm %d\n", pio_get_index(pio),sm);
 }
@@ -272,52 +399,212 @@ void Adafruit_NeoPixel::rp2040changepin(uint8_t set_pin)
 	
     if (is800KHz)
     {
-        // 800kHz, 8 bit transfers
-        ws2812byte_program_init(pio, sm, (resultpio == 0) ? pio0_offset : pio1_offset, pin, 800000, 8);
+        // 800kHz, 32 bit transfers
+        ws2812byte_program_init(pio, sm, (resultpio == 0) ? pio0_offset : pio1_offset, pin, 800000, NEO_PIO_BITS);
     }
     else
     {
-        // 400kHz, 8 bit transfers
-        ws2812byte_program_init(pio, sm, (resultpio == 0) ? pio0_offset : pio1_offset, pin, 400000, 8);
+        // 400kHz, 32 bit transfers
+        ws2812byte_program_init(pio, sm, (resultpio == 0) ? pio0_offset : pio1_offset, pin, 400000, NEO_PIO_BITS);
     }
 }
  
-void  Adafruit_NeoPixel::rp2040Show(uint8_t pin, uint8_t *pixels, uint32_t numBytes, bool is800KHz)
+/*!
+  @brief   Re-derive the state machine's clock divider from clk_sys, after
+           the system clock has been changed. The bit rate is only right
+           again once this has run, so change the clock and call this
+           between frames: with isShowing() false and canShow() true.
+*/
+void Adafruit_NeoPixel::updateClock(void)
+{
+	if (!begun) return;
+	pio_sm_set_clkdiv(pio, sm, ws2812byte_clkdiv(is800KHz ? 800000 : 400000));
+}
+
+void  HOT_FUNC(Adafruit_NeoPixel::rp2040Show)(uint8_t pin, uint8_t *pixels, uint32_t numBytes, bool is800KHz)
 { 
     PRINTF0("In Show,");
 	if (!begun)
     {
-        // On first pass through initialise the PIO
+        // On first pass through initialise the PIO. It sets begun once
+        // it has a state machine, and is tried again if it didn't get one
         rp2040Init(pin);
-		begun = true ;
     }
 
-    if (sm == -1) { return ; }
+    if (!begun) { return ; }
 
 //    PRINTF1("START TO SHOW = %d, pin = %d, 800kHz = %d, length = %d, pio= %d, sm = %d, offset = %d, no_sm = [%d, %d]\n ", begun, pin, is800KHz, numLEDs, pio_get_index(pio), sm, (pio_get_index(pio) == 0) ? pio0_offset : pio1_offset,pio_no_sm[0], pio_no_sm[1] );
-    while(numBytes--)
-        // Bits for transmission must be shifted to top 8 bits
-        pio_sm_put_blocking(pio, sm, ((uint32_t)*pixels++)<< 24);
+    uint32_t *words = (uint32_t *)pixels;
+    uint32_t numWords = NEO_WORDS(numBytes);
+
+    if (dma_chan < 0) {
+        while(numWords--)
+            // First byte in memory must be in the top 8 bits
+            pio_sm_put_blocking(pio, sm, __builtin_bswap32(*words++));
+        endTime = to_us_since_boot(make_timeout_time_us(NEO_FIFO_DRAIN_US(is800KHz)));
+        return;
+    }
+
+    // The latch period is timed from the DMA completion interrupt; until
+    // then canShow() reports the strip as busy
+    endTime = to_us_since_boot(at_the_end_of_time);
+    dma_channel_transfer_from_buffer_now(dma_chan, words, numWords);
+}
+
+/*!
+  @brief   Shared DMA_IRQ_1 handler. Acknowledges the channels owned by
+           NeoPixel strips, starts their latch timing and runs any
+           completion callback.
+*/
+void HOT_FUNC(Adafruit_NeoPixel::rp2040DmaHandler)(void)
+{
+    for (uint ch = 0; ch < NUM_DMA_CHANNELS; ch++) {
+        Adafruit_NeoPixel *strip = dma_strip[ch];
+        if (strip == NULL || !(dma_hw->ints1 & (1u << ch))) continue;
+        dma_hw->ints1 = 1u << ch;
+        // The last words are still in the FIFO when the DMA finishes
+        strip->endTime = to_us_since_boot(make_timeout_time_us(NEO_FIFO_DRAIN_US(strip->is800KHz)));
+        if (strip->showCallback) strip->showCallback(strip);
+    }
 }
 
 
 /*!
-  @brief   Transmit pixel data in RAM to NeoPixels.
-  @note    On most architectures, interrupts are temporarily disabled in
-           order to achieve the correct NeoPixel signal timing. This means
-           that the Arduino millis() and micros() functions, which require
-           interrupts, will lose small intervals of time whenever this
-           function is called (about 30 microseconds per RGB pixel, 40 for
-           RGBW pixels). There's no easy fix for this, but a few
-           specialized alternative or companion libraries exist that use
-           very device-specific peripherals to work around it.
+  @brief   Transmit pixel data in RAM to NeoPixels. Same as swap().
 */
 void Adafruit_NeoPixel::show(void) {
+  swap();
+}
+
+/*!
+  @brief   Hand the back buffer (the one setPixelColor() and friends draw
+           into) to the output engine and start sending it.
+  @note    If the previous frame is still being sent, or its latch period
+           has not yet elapsed, this waits for that first. The back buffer
+           is then written through the brightness/gamma lookup table into
+           the front buffer while no DMA transfer is reading it, and the
+           transfer is started from the front buffer. Drawing can carry on
+           in the back buffer as soon as this returns without tearing the
+           frame on the wire. Only the range of pixels touched since the
+           last frame is converted, and if the resulting frame is the same
+           as the one already on the strip it is not sent again, unless the
+           keep-alive interval (see setKeepAlive()) has passed.
+*/
+void Adafruit_NeoPixel::swap(void) {
 
   if(!pixels) return;
 
-	rp2040Show(pin, pixels, numBytes, is800KHz);
+  bool keepAlive = !frameSent || (keepAliveUs != 0 &&
+    absolute_time_diff_us(lastSent, get_absolute_time()) >= (int64_t)keepAliveUs);
+
+  // Nothing drawn since the last frame, which the strip is still showing
+  if(dirtyFirst >= dirtyEnd && !keepAlive) return;
+
+  // Data latches after a quiet period following the previous frame
+  while(!canShow());
+
+  if(!renderFront() && !keepAlive) return;
+
+  frameSent = true;
+  lastSent = get_absolute_time();
+	rp2040Show(pin, front, numBytes, is800KHz);
+}
+
+/*!
+  @brief   Resend the current frame periodically even when it has not
+           changed, so a strip that missed or mangled a frame (e.g. after
+           a power glitch) recovers.
+  @param   ms  Longest time between transmissions, in milliseconds; 0
+               (the default) only sends frames that changed.
+*/
+void Adafruit_NeoPixel::setKeepAlive(uint32_t ms) {
+  keepAliveUs = (uint64_t)ms * 1000;
+}
+
+/*!
+  @brief   Set up a 16-bit-per-channel frame buffer for showDithered(),
+           taken from the static pixel pool (3 bytes per colour byte).
+  @return  true if the buffers are available.
+  @note    Call again after changing the strip length or pixel type.
+*/
+bool Adafruit_NeoPixel::enableDithering(void) {
+  if (pixels16 != NULL) return true;
+  if (ditherBytes < numBytes) {
+    // 16-bit value plus 8-bit error accumulator per colour byte
+    uint8_t *p = neopixel_pool_alloc(3 * numBytes);
+    if (p == NULL) return false;
+    pixels16 = (uint16_t *)p;
+    ditherErr = p + 2 * numBytes;
+    ditherBytes = numBytes;
+  } else {
+    pixels16 = (uint16_t *)(ditherErr - 2 * ditherBytes);
+  }
+  memset(pixels16, 0, 2 * numBytes);
+  memset(ditherErr, 0, numBytes);
+  return true;
+}
+
+/*!
+  @brief   Set a pixel's colour in the 16-bit frame buffer used by
+           showDithered(). enableDithering() must have succeeded.
+  @param   n  Pixel index, starting from 0.
+  @param   r  Red, 0 to 65535.
+  @param   g  Green, 0 to 65535.
+  @param   b  Blue, 0 to 65535.
+  @param   w  White, 0 to 65535, ignored if using RGB pixels.
+*/
+void Adafruit_NeoPixel::setPixelColor16(
+ uint16_t n, uint16_t r, uint16_t g, uint16_t b, uint16_t w) {
 
+  if(n < numLEDs && pixels16) {
+    uint16_t *p;
+    if(wOffset == rOffset) {
+      p = &pixels16[n * 3];
+    } else {
+      p = &pixels16[n * 4];
+      p[wOffset] = w;
+    }
+    p[rOffset] = r;
+    p[gOffset] = g;
+    p[bOffset] = b;
+  }
+}
+
+/*!
+  @brief   Send the 16-bit frame buffer with temporal (sigma-delta)
+           dithering: each colour byte carries the fraction lost when
+           truncating to 8 bits into the next refresh, so levels between
+           two 8-bit steps are shown as a mix of both over time. Brightness
+           is applied at 16 bits before dithering; gamma and brightness
+           functions are not used here.
+  @note    Every call sends a frame, since the dithered output changes
+           from one refresh to the next. It needs to be called back to
+           back, as fast as the strip accepts frames (see canShow()), for
+           the dithering to be invisible.
+*/
+void Adafruit_NeoPixel::showDithered(void) {
+
+  if(!pixels || !pixels16) return;
+
+  // Data latches after a quiet period following the previous frame
+  while(!canShow());
+
+  uint32_t scale = brightness ? brightness : 256;
+  for(uint16_t i = 0; i < numBytes; i++) {
+    uint32_t v = (pixels16[i] * scale) >> 8;
+    // Keep the sum below 0x10000 so the output byte can't overflow
+    if(v > 0xff00) v = 0xff00;
+    v += ditherErr[i];
+    front[i] = v >> 8;
+    ditherErr[i] = v & 0xff;
+  }
+
+  // The 8-bit front buffer no longer holds the last swap()ed frame
+  markDirty(0, numLEDs);
+
+  frameSent = true;
+  lastSent = get_absolute_time();
+	rp2040Show(pin, front, numBytes, is800KHz);
 }
 
 /*!
@@ -360,41 +647,18 @@ void Adafruit_NeoPixel::setPixelColor(
  uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w) {
 
   if(n < numLEDs) {
-    if(brightness) { // See notes in setBrightness()
-      r = (r * brightness) >> 8;
-      g = (g * brightness) >> 8;
-      b = (b * brightness) >> 8;
-      w = (w * brightness) >> 8;
+    // Stored as given; brightness is applied by swap() on the way out
+    uint8_t *p;
+    markDirty(n, n + 1);
+    if(wOffset == rOffset) { // Is an RGB-type strip
+      p = &pixels[n * 3];    // 3 bytes per pixel
+    } else {                 // Is a WRGB-type strip
+      p = &pixels[n * 4];    // 4 bytes per pixel
+      p[wOffset] = w;        // set W
     }
-    uint8_t *p, *po;
-	if (brightfr == NULL) {
-		if(wOffset == rOffset) { // Is an RGB-type strip
-			p = &pixels[n * 3];    // 3 bytes per pixel
-		} else {                 // Is a WRGB-type strip
-			p = &pixels[n * 4];    // 4 bytes per pixel
-			p[wOffset] = w;        // set W
-		}
-		p[rOffset] = r;          // R,G,B always stored
-		p[gOffset] = g;
-		p[bOffset] = b;
-	} else {
-		if(wOffset == rOffset) { // Is an RGB-type strip
-			po = &opixels[n * 3];    // 3 bytes per pixel
-			p  =  &pixels[n * 3];
-		} else {                 // Is a WRGB-type strip
-			po = &opixels[n * 4];    // 4 bytes per pixel
-			p  =  &pixels[n * 4];
-			po[wOffset] = w;        // set W
-			p[wOffset] = brightfw(w);
-		}
-		po[rOffset] = r;          // R,G,B always stored
-		po[gOffset] = g;
-		po[bOffset] = b;
-		p[rOffset] = brightfr(r);
-		p[gOffset] = brightfg(g);
-		p[bOffset] = brightfb(b);
-	}
-	
+    p[rOffset] = r;          // R,G,B always stored
+    p[gOffset] = g;
+    p[bOffset] = b;
   }
 }
 
@@ -441,8 +705,38 @@ void Adafruit_NeoPixel::fill(uint32_t c, uint16_t first, uint16_t count) {
     if(end > numLEDs) end = numLEDs;
   }
 
-  for(i = first; i < end; i++) {
-    this->setPixelColor(i, c);
+  // Build the 3- or 4-byte pattern for this colour once
+  uint8_t pat[4];
+  pat[rOffset] = (uint8_t)(c >> 16);
+  pat[gOffset] = (uint8_t)(c >>  8);
+  pat[bOffset] = (uint8_t)c;
+  markDirty(first, end);
+
+  if(wOffset != rOffset) { // RGBW: one aligned word per pixel
+    pat[wOffset] = (uint8_t)(c >> 24);
+    uint32_t w = pat[0] | (pat[1] << 8) | (pat[2] << 16) | ((uint32_t)pat[3] << 24);
+    uint32_t *p = (uint32_t *)pixels + first;
+    for(i = first; i < end; i++) *p++ = w;
+    return;
+  }
+
+  // RGB: pixels line up with words every 4 pixels (12 bytes), so set
+  // single pixels up to a multiple of 4, then store 3 words per 4 pixels
+  uint8_t *p = &pixels[first * 3];
+  for(i = first; i < end && (i & 3); i++, p += 3) {
+    p[0] = pat[0]; p[1] = pat[1]; p[2] = pat[2];
+  }
+  uint32_t w0 = pat[0] | (pat[1] << 8) | (pat[2] << 16) | ((uint32_t)pat[0] << 24);
+  uint32_t w1 = pat[1] | (pat[2] << 8) | (pat[0] << 16) | ((uint32_t)pat[1] << 24);
+  uint32_t w2 = pat[2] | (pat[0] << 8) | (pat[1] << 16) | ((uint32_t)pat[2] << 24);
+  uint32_t *wp = (uint32_t *)p;
+  for(; i + 4 <= end; i += 4) {
+    *wp++ = w0;
+    *wp++ = w1;
+    *wp++ = w2;
+  }
+  for(p = (uint8_t *)wp; i < end; i++, p += 3) {
+    p[0] = pat[0]; p[1] = pat[1]; p[2] = pat[2];
   }
 }
 
@@ -545,85 +839,107 @@ uint32_t Adafruit_NeoPixel::ColorHSV(uint16_t hue, uint8_t sat, uint8_t val) {
          ( ((((b * s1) >> 8) + s2) * v1)           >> 8);
 }
 
+// Hue segment tables for fillHSV(). Each sixth of the colour wheel has one
+// component at full, one ramping (up, or down if seg_down is set) and one
+// at zero; entry 6 is the last half-step of red (hue 1530). Components are
+// numbered 0 = red, 1 = green, 2 = blue.
+static const uint8_t HOT_DATA("neopixel_hsv") seg_full[7] = {0, 1, 1, 2, 2, 0, 0};
+static const uint8_t HOT_DATA("neopixel_hsv") seg_ramp[7] = {1, 0, 2, 1, 0, 2, 1};
+static const uint8_t HOT_DATA("neopixel_hsv") seg_zero[7] = {2, 2, 0, 0, 1, 1, 2};
+static const uint8_t HOT_DATA("neopixel_hsv") seg_down[7] = {0, 1, 0, 1, 0, 1, 0};
+
+/*!
+  @brief   Fill a run of pixels with colours from the HSV colour wheel, one
+           hue per pixel. Gives the same colours as calling ColorHSV() (and
+           optionally gamma32()) and setPixelColor() for each pixel, but
+           saturation and value are only worked out once for the whole
+           span and the hue-to-RGB step needs no division.
+  @param   first  Index of first pixel to fill, starting from 0.
+  @param   count  Number of pixels to fill; clipped to the end of the strip.
+  @param   hues   count 16-bit hues, as for ColorHSV().
+  @param   sat    Saturation, 0 (grayscale) to 255 (pure hue).
+  @param   val    Value, 0 (off) to 255 (full brightness).
+  @param   gamma  true to gamma-correct the resulting components.
+  @note    The white component of RGBW pixels is set to 0.
+*/
+void HOT_FUNC(Adafruit_NeoPixel::fillHSV)(uint16_t first, uint16_t count,
+  const uint16_t *hues, uint8_t sat, uint8_t val, bool gamma) {
+
+  if(first >= numLEDs) return;
+  if(count > numLEDs - first) count = numLEDs - first;
+
+  // Saturation and value as in ColorHSV(); only the ramping component
+  // varies from pixel to pixel, the full and zero ones are constant
+  uint32_t v1 =   1 + val;
+  uint16_t s1 =   1 + sat;
+  uint8_t  s2 = 255 - sat;
+  uint8_t  full = ((((255 * s1) >> 8) + s2) * v1) >> 8;
+  uint8_t  zero = (s2 * v1) >> 8;
+  if(gamma) {
+    full = gamma8(full);
+    zero = gamma8(zero);
+  }
+
+  uint8_t  bpp  = (wOffset == rOffset) ? 3 : 4;
+  uint8_t  offset[3] = {rOffset, gOffset, bOffset};
+  uint8_t *p = &pixels[first * bpp];
+  markDirty(first, first + count);
+
+  for(uint16_t i = 0; i < count; i++, p += bpp) {
+    // 0-65535 to 0-1530, then to a sixth of the wheel: (h + 1) * 257 >> 16
+    // equals (h + 1) / 255 over this range
+    uint32_t h   = ((uint32_t)hues[i] * 1530 + 32768) >> 16;
+    uint32_t seg = ((h + 1) * 257) >> 16;
+    uint32_t x   = h - seg * 255;
+    if(seg_down[seg]) x = 255 - x;
+    uint8_t ramp = ((((x * s1) >> 8) + s2) * v1) >> 8;
+    if(gamma) ramp = gamma8(ramp);
+
+    p[offset[seg_full[seg]]] = full;
+    p[offset[seg_ramp[seg]]] = ramp;
+    p[offset[seg_zero[seg]]] = zero;
+    if(bpp == 4) p[wOffset] = 0;
+  }
+}
+
 /*!
   @brief   Query the color of a previously-set pixel.
   @param   n  Index of pixel to read (0 = first).
   @return  'Packed' 32-bit RGB or WRGB value. Most significant byte is white
            (for RGBW pixels) or 0 (for RGB pixels), next is red, then green,
            and least significant byte is blue.
-  @note    If the strip brightness has been changed from the default value
-           of 255, the color read from a pixel may not exactly match what
-           was previously written with one of the setPixelColor() functions.
-           This gets more pronounced at lower brightness levels.
+  @note    Brightness is applied when a frame is sent, so this returns
+           exactly what was written with one of the setPixelColor()
+           functions.
 */
 uint32_t Adafruit_NeoPixel::getPixelColor(uint16_t n) const {
   if(n >= numLEDs) return 0; // Out of bounds, return no color.
 
-  uint8_t *p, *po;
-  
-  if (brightfr == NULL) {
-	if(wOffset == rOffset) { // Is RGB-type device
-		p = &pixels[n * 3];
-		if(brightness) {
-		// Stored color was decimated by setBrightness(). Returned value
-		// attempts to scale back to an approximation of the original 24-bit
-		// value used when setting the pixel color, but there will always be
-		// some error -- those bits are simply gone. Issue is most
-		// pronounced at low brightness levels.
-		return (((uint32_t)(p[rOffset] << 8) / brightness) << 16) |
-				(((uint32_t)(p[gOffset] << 8) / brightness) <<  8) |
-				( (uint32_t)(p[bOffset] << 8) / brightness       );
-		} else {
-		// No brightness adjustment has been made -- return 'raw' color
-		return ((uint32_t)p[rOffset] << 16) |
-				((uint32_t)p[gOffset] <<  8) |
-				(uint32_t)p[bOffset];
-		}
-	} else {                 // Is RGBW-type device
-		p = &pixels[n * 4];
-		if(brightness) { // Return scaled color
-		return (((uint32_t)(p[wOffset] << 8) / brightness) << 24) |
-				(((uint32_t)(p[rOffset] << 8) / brightness) << 16) |
-				(((uint32_t)(p[gOffset] << 8) / brightness) <<  8) |
-				( (uint32_t)(p[bOffset] << 8) / brightness       );
-		} else { // Return raw color
-		return ((uint32_t)p[wOffset] << 24) |
-				((uint32_t)p[rOffset] << 16) |
-				((uint32_t)p[gOffset] <<  8) |
-				(uint32_t)p[bOffset];
-		}
-	}
-  } else { // else take the values from the original array
-  	if(wOffset == rOffset) { // Is RGB-type device
-		po = &opixels[n * 3];
-		return ((uint32_t)po[rOffset] << 16) |
-				((uint32_t)po[gOffset] <<  8) |
-				(uint32_t)po[bOffset];
-	} else {                 // Is RGBW-type device
-		po = &opixels[n * 4];
-		return ((uint32_t)po[wOffset] << 24) |
-				((uint32_t)po[rOffset] << 16) |
-				((uint32_t)po[gOffset] <<  8) |
-				(uint32_t)po[bOffset];
-	}
+  uint8_t *p;
+
+  if(wOffset == rOffset) { // Is RGB-type device
+    p = &pixels[n * 3];
+    return ((uint32_t)p[rOffset] << 16) |
+           ((uint32_t)p[gOffset] <<  8) |
+            (uint32_t)p[bOffset];
+  } else {                 // Is RGBW-type device
+    p = &pixels[n * 4];
+    return ((uint32_t)p[wOffset] << 24) |
+           ((uint32_t)p[rOffset] << 16) |
+           ((uint32_t)p[gOffset] <<  8) |
+            (uint32_t)p[bOffset];
   }
 }
 
-
 /*!
   @brief   Adjust output brightness. Does not immediately affect what's
            currently displayed on the LEDs. The next call to show() will
            refresh the LEDs at this level.
   @param   b  Brightness setting, 0=minimum (off), 255=brightest.
-  @note    This was intended for one-time use in one's setup() function,
-           not as an animation effect in itself. Because of the way this
-           library "pre-multiplies" LED colors in RAM, changing the
-           brightness is often a "lossy" operation -- what you write to
-           pixels isn't necessary the same as what you'll read back.
-           Repeated brightness changes using this function exacerbate the
-           problem. Smart programs therefore treat the strip as a
-           write-only resource, maintaining their own state to render each
-           frame of an animation, not relying on read-modify-write.
+  @note    Brightness is folded into the output lookup table applied by
+           swap(), so the stored pixel data is not touched and changing
+           the brightness is lossless and costs 256 table entries rather
+           than a pass over the strip.
 */
 void Adafruit_NeoPixel::setBrightness(uint8_t b) {
   // Stored brightness value is different than what's passed.
@@ -634,51 +950,132 @@ void Adafruit_NeoPixel::setBrightness(uint8_t b) {
   // brightness (off), 255 = just below max brightness.
   uint8_t newBrightness = b + 1;
   if(newBrightness != brightness) { // Compare against prior value
-    // Brightness has changed -- re-scale existing data in RAM,
-    // This process is potentially "lossy," especially when increasing
-    // brightness. The tight timing in the WS2811/WS2812 code means there
-    // aren't enough free cycles to perform this scaling on the fly as data
-    // is issued. So we make a pass through the existing color data in RAM
-    // and scale it (subsequent graphics commands also work at this
-    // brightness level). If there's a significant step up in brightness,
-    // the limited number of steps (quantization) in the old data will be
-    // quite visible in the re-scaled version. For a non-destructive
-    // change, you'll need to re-render the full strip data. C'est la vie.
-    uint8_t  c,
-            *ptr           = pixels,
-             oldBrightness = brightness - 1; // De-wrap old brightness value
-    uint16_t scale;
-    if(oldBrightness == 0) scale = 0; // Avoid /0
-    else if(b == 255) scale = 65535 / oldBrightness;
-    else scale = (((uint16_t)newBrightness << 8) - 1) / oldBrightness;
-    for(uint16_t i=0; i<numBytes; i++) {
-      c      = *ptr;
-      *ptr++ = (c * scale) >> 8;
-    }
     brightness = newBrightness;
+    updateLut();
+  }
+}
+
+/*!
+  @brief   Turn gamma correction of the output on or off. When on, every
+           colour component is passed through gamma8() before brightness
+           is applied, as part of the same output lookup table.
+  @param   on  true to gamma-correct the output.
+*/
+void Adafruit_NeoPixel::setGamma(bool on) {
+  if (on != gammaOn) {
+    gammaOn = on;
+    updateLut();
   }
 }
 
+/*!
+  @brief   Install per-channel brightness conversion functions, applied
+           after brightness scaling when a frame is sent. Pass NULL for
+           all four to remove them.
+  @note    The functions are sampled once into per-channel lookup tables
+           here, not called per pixel.
+*/
 void Adafruit_NeoPixel::setBrightnessFunctions(pBrightnessFunc fr, pBrightnessFunc fg, pBrightnessFunc fb, pBrightnessFunc fw) {
-	
-	if (opixels == NULL & numLEDs != 0) {
-        opixels = (uint8_t *)malloc(numBytes);
-		memcpy(opixels,pixels,numBytes);
-	}
-	
 	brightfr = fr;
 	brightfg = fg;
 	brightfb = fb;
 	brightfw = fw;
-	
-	for (int i = 0 ; i < numLEDs ; i++) {
-		uint32_t pixel;
-		pixel = getPixelColor(i);
-		setPixelColor(i,pixel);
-	}
+	updateLut();
 };
-		
 
+/*!
+  @brief   Rebuild the output lookup table(s) from the brightness, gamma
+           and brightness function settings. With per-channel functions
+           there is one 256-entry table for each byte position within a
+           pixel; otherwise one table serves every byte, and none is used
+           at all when the output equals the stored data.
+*/
+void Adafruit_NeoPixel::updateLut(void) {
+  bool perChannel = (brightfr != NULL || brightfg != NULL ||
+                     brightfb != NULL || brightfw != NULL);
+  uint16_t need = perChannel ? 4 * 256 : 256;
+
+  lutMode = NEO_LUT_NONE;
+  markDirty(0, numLEDs); // every output byte may change
+  if (!perChannel && !gammaOn && brightness == 0) return; // identity
+
+  if (need > lutSize) {
+    // Taken from the pool and kept; a smaller table is given back first
+    // if nothing has been taken since
+    neopixel_pool_free(lut, lutSize);
+    lut = NULL;
+    lutSize = 0;
+    uint8_t *newLut = neopixel_pool_alloc(need);
+    if (newLut == NULL) return;
+    lut = newLut;
+    lutSize = need;
+  }
+
+  pBrightnessFunc fn[4] = {NULL, NULL, NULL, NULL};
+  if (perChannel) {
+    fn[rOffset] = brightfr;
+    fn[gOffset] = brightfg;
+    fn[bOffset] = brightfb;
+    if (wOffset != rOffset) fn[wOffset] = brightfw;
+  }
+
+  for (uint16_t c = 0; c < (perChannel ? 4 : 1); c++) {
+    uint8_t *table = &lut[c * 256];
+    for (uint16_t v = 0; v < 256; v++) {
+      uint8_t x = gammaOn ? gamma8(v) : v;
+      if (brightness) x = (x * brightness) >> 8;
+      table[v] = fn[c] ? fn[c](x) : x;
+    }
+  }
+  lutMode = perChannel ? NEO_LUT_CHANNEL : NEO_LUT_SHARED;
+}
+
+/*!
+  @brief   Write the pixels drawn since the last frame through the output
+           lookup table into the front buffer, and reset the dirty range.
+           The rest of the front buffer still holds the previous frame.
+  @return  true if any output byte differs from the previous frame.
+*/
+bool HOT_FUNC(Adafruit_NeoPixel::renderFront)(void) {
+  if (dirtyFirst >= dirtyEnd) return false;
+
+  uint8_t  bpp = (wOffset == rOffset) ? 3 : 4;
+  uint16_t start = dirtyFirst * bpp;
+  uint16_t len = (dirtyEnd - dirtyFirst) * bpp;
+  uint8_t *src = pixels + start, *dst = front + start;
+  uint16_t i;
+  uint8_t  diff = 0, v;
+  dirtyFirst = numLEDs;
+  dirtyEnd = 0;
+
+  // Redrawing a pixel with the colour it already had still marks it
+  // dirty, so compare each output byte with the previous frame as it is
+  // written
+  switch (lutMode) {
+  case NEO_LUT_NONE:
+    if (memcmp(dst, src, len) == 0) return false;
+    memcpy(dst, src, len);
+    return true;
+  case NEO_LUT_SHARED:
+    for (i = 0; i < len; i++) {
+      v = lut[src[i]];
+      diff |= dst[i] ^ v;
+      dst[i] = v;
+    }
+    break;
+  case NEO_LUT_CHANNEL:
+    // byte position within the pixel selects the table
+    for (i = 0; i < len; ) {
+      for (uint16_t c = 0; c < bpp; c++, i++) {
+        v = lut[(c << 8) + src[i]];
+        diff |= dst[i] ^ v;
+        dst[i] = v;
+      }
+    }
+    break;
+  }
+  return diff != 0;
+}
 
 /*!
   @brief   Retrieve the last-set brightness value for the strip.
@@ -693,6 +1090,7 @@ uint8_t Adafruit_NeoPixel::getBrightness(void) const {
 */
 void Adafruit_NeoPixel::clear(void) {
   memset(pixels, 0, numBytes);
+  markDirty(0, numLEDs);
 }
 
 // A 32-bit variant of gamma8() that applies the same function
@@ -710,3 +1108,22 @@ uint32_t Adafruit_NeoPixel::gamma32(uint32_t x) {
   for(uint8_t i=0; i<4; i++) y[i] = gamma8(y[i]);
   return x; // Packed 32-bit return
 }
+
+/*!
+  @brief   Gamma-correct a run of packed RGB or WRGB colours in place, the
+           same as calling gamma32() on each one.
+  @param   colors  Packed colours.
+  @param   count   Number of colours.
+  @note    Works a word at a time: each colour is loaded once, its four
+           bytes are looked up and the result is stored as one word.
+*/
+void HOT_FUNC(Adafruit_NeoPixel::gammaSpan)(uint32_t *colors, uint16_t count) {
+  const uint8_t *g = _NeoPixelGammaTable;
+  for(uint16_t i = 0; i < count; i++) {
+    uint32_t x = colors[i];
+    colors[i] = ((uint32_t)g[ x >> 24        ] << 24) |
+                ((uint32_t)g[(x >> 16) & 0xff] << 16) |
+                ((uint32_t)g[(x >>  8) & 0xff] <<  8) |
+                 (uint32_t)g[ x        & 0xff];
+  }
+}
@@ -0,0 +1,192 @@
+/*!
+ * @file Adafruit_NeoPixelParallel.cpp
+ *
+ * Parallel output for several Adafruit_NeoPixel strips, see
+ * Adafruit_NeoPixelParallel.hpp.
+ *
+ * This file is part of the Adafruit_NeoPixel library.
+ *
+ * Adafruit_NeoPixel is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ */
+
+#include "Adafruit_NeoPixelParallel.hpp"
+#include <cstring>
+
+// offsets of the loaded parallel program on pio0 / pio1; -1 if not loaded
+static int parallel_offset[2] = {-1, -1};
+static int parallel_no_sm[2] = {0, 0};
+
+/*!
+  @brief   Parallel output constructor.
+  @param   p  Pin of the first strip; strip n is output on p + n.
+  @param   t  NEO_KHZ800 or NEO_KHZ400 (any colour order bits are ignored,
+              each strip keeps its own).
+*/
+Adafruit_NeoPixelParallel::Adafruit_NeoPixelParallel(uint16_t p, neoPixelType t) :
+  is800KHz(t < 256), begun(false), basePin(p), nStrips(0), maxBytes(0), planes(NULL),
+  pio(pio0), sm(-1), offset(-1), dma_chan(-1) {
+  endTime = get_absolute_time();
+  for (int i = 0; i < NEO_PARALLEL_MAX_STRIPS; i++) strips[i] = NULL;
+}
+
+/*!
+  @brief   Blank all strips and release the state machine, program and
+           DMA channel.
+*/
+Adafruit_NeoPixelParallel::~Adafruit_NeoPixelParallel() {
+  if (begun) {
+    for (uint8_t s = 0; s < nStrips; s++) strips[s]->clear();
+    show();
+    while (isShowing()) ;
+    sleep_ms(20);
+    dma_channel_unclaim(dma_chan);
+    pio_sm_unclaim(pio, sm);
+    if (--parallel_no_sm[pio_get_index(pio)] == 0) {
+      pio_remove_program(pio, &ws2812parallel_program, offset);
+      parallel_offset[pio_get_index(pio)] = -1;
+    }
+  }
+  releasePlanes();
+}
+
+/*!
+  @brief   Attach a strip to the next output lane. The transposed frame
+           is taken from the pixel pool on the first show(), sized for the
+           longest strip then; a strip that grows later is sent only up to
+           that length.
+  @param   strip  Strip whose pixel buffer is sent on basePin + numStrips().
+  @return  false if all lanes are in use or output has already started.
+*/
+bool Adafruit_NeoPixelParallel::addStrip(Adafruit_NeoPixel *strip) {
+  if (begun || nStrips >= NEO_PARALLEL_MAX_STRIPS) return false;
+  strips[nStrips++] = strip;
+  return true;
+}
+
+// Gives the transposed frame back to the pool
+void Adafruit_NeoPixelParallel::releasePlanes(void) {
+  neopixel_pool_free(planes, (uint32_t)maxBytes * 8);
+  planes = NULL;
+  maxBytes = 0;
+}
+
+bool Adafruit_NeoPixelParallel::rp2040Init(void) {
+  PIO pios[2] = {pio0, pio1};
+
+  uint16_t longest = 0;
+  for (uint8_t s = 0; s < nStrips; s++) {
+    if (strips[s]->numBytes > longest) longest = strips[s]->numBytes;
+  }
+  planes = neopixel_pool_alloc((uint32_t)longest * 8);
+  if (!planes) return false;
+  maxBytes = longest;
+
+  for (int i = 0; i < 2 && sm == -1; i++) {
+    int resultsm = pio_claim_unused_sm(pios[i], false);
+    if (resultsm == -1) continue;
+    if (parallel_offset[i] == -1) {
+      if (!pio_can_add_program(pios[i], &ws2812parallel_program)) {
+        pio_sm_unclaim(pios[i], resultsm);
+        continue;
+      }
+      parallel_offset[i] = pio_add_program(pios[i], &ws2812parallel_program);
+    }
+    pio = pios[i];
+    sm = resultsm;
+    offset = parallel_offset[i];
+  }
+  if (sm == -1) {
+    releasePlanes();
+    return false;
+  }
+
+  dma_chan = dma_claim_unused_channel(false);
+  if (dma_chan < 0) {
+    pio_sm_unclaim(pio, sm);
+    sm = -1;
+    releasePlanes();
+    return false;
+  }
+  parallel_no_sm[pio_get_index(pio)]++;
+
+  ws2812parallel_program_init(pio, sm, offset, basePin, nStrips,
+                              is800KHz ? 800000 : 400000);
+
+  dma_channel_config c = dma_channel_get_default_config(dma_chan);
+  channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+  channel_config_set_read_increment(&c, true);
+  channel_config_set_write_increment(&c, false);
+  channel_config_set_dreq(&c, pio_get_dreq(pio, sm, true));
+  dma_channel_configure(dma_chan, &c, &pio->txf[sm], NULL, 0, false);
+
+  begun = true;
+  return true;
+}
+
+/*!
+  @brief   Re-derive the state machine's clock divider from clk_sys, after
+           the system clock has been changed. Call it between frames, as
+           for Adafruit_NeoPixel::updateClock().
+*/
+void Adafruit_NeoPixelParallel::updateClock(void) {
+  if (!begun) return;
+  pio_sm_set_clkdiv(pio, sm, ws2812parallel_clkdiv(is800KHz ? 800000 : 400000));
+}
+
+/*!
+  @brief   Rebuild the bit-transposed frame from the strips' front buffers. Byte
+           k of every strip becomes 8 consecutive plane bytes, MSB first,
+           each holding that bit for all strips (strip n in bit n). Shorter
+           strips are padded with zeros, which fall off their far end.
+*/
+void Adafruit_NeoPixelParallel::transpose(void) {
+  uint8_t *out = planes;
+
+  for (uint16_t k = 0; k < maxBytes; k++) {
+    // Row n of the 8x8 bit matrix is byte k of strip n
+    uint64_t x = 0;
+    for (uint8_t s = 0; s < nStrips; s++) {
+      if (k < strips[s]->numBytes)
+        x |= (uint64_t)strips[s]->front[k] << (8 * s);
+    }
+
+    // Transpose in place (Hacker's Delight, transpose8)
+    uint64_t t;
+    t = (x ^ (x >>  7)) & 0x00AA00AA00AA00AAULL; x = x ^ t ^ (t <<  7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCULL; x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ULL; x = x ^ t ^ (t << 28);
+
+    // The plane for the MSB is now in the top byte
+    for (int j = 0; j < 8; j++) *out++ = (uint8_t)(x >> (56 - 8 * j));
+  }
+}
+
+/*!
+  @brief   Transmit all attached strips at once. Returns as soon as the DMA
+           transfer has started; waits first if the previous frame has not
+           finished and latched. The strips' buffers may be modified as
+           soon as this returns, since a transposed copy is sent.
+*/
+void Adafruit_NeoPixelParallel::show(void) {
+  if (nStrips == 0) return;
+
+  while (!canShow());
+
+  if (!begun && !rp2040Init()) return;
+
+  // Apply each strip's brightness/gamma tables into its front buffer
+  for (uint8_t s = 0; s < nStrips; s++) {
+    if (strips[s]->pixels) strips[s]->renderFront();
+  }
+  transpose();
+
+  // The PIO paces the DMA, so the frame ends a fixed time from now: one
+  // plane byte per bit period
+  uint32_t bitTimes = (uint32_t)maxBytes * 8;
+  endTime = make_timeout_time_us((bitTimes * (is800KHz ? 125 : 250) + 99) / 100);
+  dma_channel_transfer_from_buffer_now(dma_chan, planes, bitTimes / 4);
+}
@@ -37,8 +37,10 @@
 #pragma once
 #include "pico/stdio.h"
 #include "hardware/pio.h"
+#include "hardware/dma.h"
 #include "pico/time.h"
 #include "ws2812byte.pio.h"
+#include "hot_in_ram.h"
 
 
 
@@ -120,6 +122,8 @@
 
 typedef uint16_t neoPixelType; ///< 3rd arg to Adafruit_NeoPixel constructor
 typedef uint8_t (* pBrightnessFunc)(uint8_t value) ; // pointer to a brigness conversion function
+class Adafruit_NeoPixel;
+typedef void (* pShowCompleteFunc)(Adafruit_NeoPixel *strip) ; // called from the DMA IRQ when a frame has been sent
 
 // These two tables are declared outside the Adafruit_NeoPixel class
 // because some boards may require oldschool compilers that don't
@@ -132,7 +136,7 @@ for x in range(256):
     print("{:3},".format(int((math.sin(x/128.0*math.pi)+1.0)*127.5+0.5))),
     if x&15 == 15: print
 */
-static const uint8_t _NeoPixelSineTable[256] = {
+static const uint8_t HOT_DATA("neopixel_tables") _NeoPixelSineTable[256] = {
   128,131,134,137,140,143,146,149,152,155,158,162,165,167,170,173,
   176,179,182,185,188,190,193,196,198,201,203,206,208,211,213,215,
   218,220,222,224,226,228,230,232,234,235,237,238,240,241,243,244,
@@ -158,7 +162,7 @@ for x in range(256):
     print("{:3},".format(int(math.pow((x)/255.0,gamma)*255.0+0.5))),
     if x&15 == 15: print
 */
-static const uint8_t _NeoPixelGammaTable[256] = {
+static const uint8_t HOT_DATA("neopixel_tables") _NeoPixelGammaTable[256] = {
     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
     0,  0,  0,  0,  0,  0,  0,  0,  1,  1,  1,  1,  1,  1,  1,  1,
     1,  1,  1,  1,  2,  2,  2,  2,  2,  2,  2,  2,  3,  3,  3,  3,
@@ -181,6 +185,24 @@ static int pio0_offset = -1;   		// offset of loaded pio neopixel program on pio
 static int pio1_offset = -1;		// offset of loaded pio neopixel program on pio1; -1 if no program loaded
 static int pio_no_sm[2] = {0,0} ;	// number of state machines in use for Neopixel  
 
+// Size of the static pool that pixel buffers are taken from. Every strip
+// needs a front and a back buffer of 3 or 4 bytes per pixel, each rounded
+// up to a whole word, and parallel output 8 bytes per byte of its longest
+// strip.
+#ifndef NEOPIXEL_POOL_BYTES
+#define NEOPIXEL_POOL_BYTES 4096
+#endif
+
+// Take space from the pool, or NULL if there isn't enough, and give back
+// the most recent allocation
+uint8_t *neopixel_pool_alloc(uint32_t bytes);
+void     neopixel_pool_free(uint8_t *p, uint32_t bytes);
+
+// How swap() turns stored pixel data into output data
+#define NEO_LUT_NONE    0 ///< Output is the stored data
+#define NEO_LUT_SHARED  1 ///< One brightness/gamma table for every byte
+#define NEO_LUT_CHANNEL 2 ///< One table per byte position (brightness functions)
+
 static uint8_t  neopixels_gamma8(uint8_t x) {
     return _NeoPixelGammaTable[x]; // 0-255 in, 0-255 out
   }
@@ -201,14 +223,31 @@ class Adafruit_NeoPixel {
 
   void              begin(void);
   void              show(void);
+  void              swap(void);
+  void              setKeepAlive(uint32_t ms);
+  bool              enableDithering(void);
+  void              setPixelColor16(uint16_t n, uint16_t r, uint16_t g,
+                      uint16_t b, uint16_t w=0);
+  void              showDithered(void);
   void 				setBrightnessFunctions(pBrightnessFunc fr, pBrightnessFunc fg, pBrightnessFunc fb, pBrightnessFunc fw);
+  /*!
+    @brief   Install a function to be called when show() has finished
+             handing a frame to the PIO. It runs in the DMA interrupt
+             handler on the core that first called show(), so it must be
+             short and must not block.
+    @param   cb  Callback, or NULL to remove it.
+  */
+  void              setShowCompleteCallback(pShowCompleteFunc cb) { showCallback = cb; }
   void              setPin(uint16_t p);
   void              setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b);
   void              setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b,
                       uint8_t w);
   void              setPixelColor(uint16_t n, uint32_t c);
   void              fill(uint32_t c=0, uint16_t first=0, uint16_t count=0);
+  void              fillHSV(uint16_t first, uint16_t count, const uint16_t *hues,
+                      uint8_t sat=255, uint8_t val=255, bool gamma=false);
   void              setBrightness(uint8_t);
+  void              setGamma(bool on);
   void              clear(void);
   void              updateLength(uint16_t n);
   void              updateType(neoPixelType t);
@@ -226,11 +265,15 @@ class Adafruit_NeoPixel {
              if show() would block (meaning some idle time is available).
   */
   bool canShow(void) {
-    int64_t howlongago = absolute_time_diff_us (endTime, get_absolute_time());
+    // endTime sits at the end of time while a DMA transfer is running,
+    // where the difference below would wrap round to a positive value
+    absolute_time_t latch = latchStart();
+    if (is_at_the_end_of_time(latch)) return false;
+    int64_t howlongago = absolute_time_diff_us (latch, get_absolute_time());
     return (howlongago >= 300L);
   }
   /*!
-    @brief   Get a pointer directly to the NeoPixel data buffer in RAM.
+    @brief   Get a pointer directly to the NeoPixel back buffer in RAM.
              Pixel data is stored in a device-native format (a la the NEO_*
              constants) and is not translated here. Applications that access
              this buffer will need to be aware of the specific data format
@@ -243,7 +286,30 @@ class Adafruit_NeoPixel {
              writes past the ends of the buffer. Great power, great
              responsibility and all that.
   */
-  uint8_t          *getPixels(void) const { return pixels; };
+  uint8_t          *getPixels(void) const {
+    markDirty(0, numLEDs); // caller may write anywhere
+    return pixels;
+  };
+  /*!
+    @brief   Flag a range of pixels as changed, for code that writes to
+             the buffer from getPixels() between frames.
+    @param   first  Index of first changed pixel.
+    @param   end    Index one past the last changed pixel.
+  */
+  void              markDirty(uint16_t first, uint16_t end) const {
+    if (first < dirtyFirst) dirtyFirst = first;
+    if (end > dirtyEnd) dirtyEnd = end;
+  }
+  /*!
+    @brief   Check whether a frame started by show() is still being
+             streamed out by DMA.
+    @return  true while the front buffer is being read by the DMA channel,
+             false once the transfer has completed (the latch period may
+             still be running, see canShow()).
+  */
+  bool              isShowing(void) const {
+    return (dma_chan >= 0) && dma_channel_is_busy(dma_chan);
+  }
   uint8_t           getBrightness(void) const;
   /*!
     @brief   Retrieve the pin number used for NeoPixel data output.
@@ -328,29 +394,64 @@ class Adafruit_NeoPixel {
              function instead.
   */
   static uint32_t   gamma32(uint32_t x);
+  static void       gammaSpan(uint32_t *colors, uint16_t count);
 
 
   void rp2040Init(uint8_t pin) ;
   void rp2040Show(uint8_t pin, uint8_t *pixels, uint32_t numBytes, bool is800KHz);
   void rp2040changepin(uint8_t set_pin);
+  void updateClock(void);
 
  protected:
 
+  static void       rp2040DmaHandler(void);
+  void              updateLut(void);
+  void              releaseExtras(void);
+  bool              renderFront(void);
+  friend class      Adafruit_NeoPixelParallel;
+
+  /*!
+    @brief   endTime, read so that a write from the DMA IRQ (or from the
+             other core) can't be seen half done: the two halves of a
+             64-bit value are separate loads, so read it until it comes
+             out the same twice.
+  */
+  absolute_time_t latchStart(void) const {
+    uint64_t t = endTime, u;
+    while ((u = endTime) != t) t = u;
+    return from_us_since_boot(t);
+  }
+
   bool              is800KHz;   ///< true if 800 KHz pixels
   bool              begun;      ///< true if the state machines & pio has started (after the first show). 
   uint16_t          numLEDs;    ///< Number of RGB LEDs in strip
   uint16_t          numBytes;   ///< Size of 'pixels' buffer below
   int16_t           pin;        ///< Output pin number (-1 if not yet set)
   uint8_t           brightness; ///< Strip brightness 0-255 (stored as +1)
-  uint8_t          *pixels;     ///< Holds LED color values (3 or 4 bytes each)
-  uint8_t		   *opixels;	///< Hold originally set LED color values ( 3 or 4 bytes each)
+  uint8_t          *pixels;     ///< Back buffer: LED color values being drawn (3 or 4 bytes each)
+  uint8_t          *front;      ///< Front buffer: frame handed to the DMA by swap()
+  uint16_t          capacity;   ///< Allocated size of each buffer, in bytes
+  mutable uint16_t  dirtyFirst; ///< First pixel changed since the last frame
+  mutable uint16_t  dirtyEnd;   ///< One past the last changed pixel; empty if <= dirtyFirst
+  uint8_t          *lut;        ///< Output lookup table(s), 256 entries each
+  uint16_t          lutSize;    ///< Allocated size of lut, in bytes
+  uint8_t           lutMode;    ///< NEO_LUT_NONE, NEO_LUT_SHARED or NEO_LUT_CHANNEL
+  bool              gammaOn;    ///< true if output is gamma corrected
   uint8_t           rOffset;    ///< Red index within each 3- or 4-byte pixel
   uint8_t           gOffset;    ///< Index of green byte
   uint8_t           bOffset;    ///< Index of blue byte
   uint8_t           wOffset;    ///< Index of white (==rOffset if no white)
-  absolute_time_t   endTime;    ///< Latch timing reference
+  volatile uint64_t endTime;    ///< Latch timing reference, us since boot; set by the DMA IRQ
+  absolute_time_t   lastSent;   ///< When the last frame was sent
+  bool              frameSent;  ///< false until a frame has gone out since updateLength()
+  uint64_t          keepAliveUs; ///< Resend unchanged frames after this long; 0 = never
+  uint16_t         *pixels16;   ///< 16-bit colour values for showDithered(); NULL if not enabled
+  uint8_t          *ditherErr;  ///< Sigma-delta remainder carried per colour byte
+  uint16_t          ditherBytes; ///< Colour bytes the dither buffers were allocated for
   PIO				pio;		///< chosen pio for this object
   uint				sm;			///<chosen state machine for this object; -1 if not yet set or none available. 
+  int				dma_chan;	///< DMA channel feeding the state machine; -1 if none available
+  pShowCompleteFunc	showCallback; ///< called when a DMA transfer completes
   pBrightnessFunc	brightfr,
 					brightfg,
 					brightfb,
@@ -0,0 +1,82 @@
+/*!
+ * @file Adafruit_NeoPixelParallel.hpp
+ *
+ * Parallel output for several Adafruit_NeoPixel strips on adjacent pins,
+ * driven from one PIO state machine and one DMA channel. The strips keep
+ * their own pixel buffers (and all of the usual colour functions); only
+ * the transmission is shared, so a frame takes as long as the longest
+ * strip rather than the sum of all of them.
+ *
+ * This file is part of the Adafruit_NeoPixel library.
+ *
+ * Adafruit_NeoPixel is free software: you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+ *
+ */
+
+#pragma once
+#include "Adafruit_NeoPixel.hpp"
+#include "ws2812parallel.pio.h"
+
+#define NEO_PARALLEL_MAX_STRIPS 8 ///< One bit per strip in each FIFO byte
+
+/*!
+    @brief  Sends up to NEO_PARALLEL_MAX_STRIPS Adafruit_NeoPixel strips
+            simultaneously. Strip n (in the order added) is output on
+            basePin + n. Strips added here must not be show()n directly.
+*/
+class Adafruit_NeoPixelParallel {
+
+ public:
+
+  Adafruit_NeoPixelParallel(uint16_t basePin, neoPixelType type=NEO_KHZ800);
+  ~Adafruit_NeoPixelParallel();
+
+  bool              addStrip(Adafruit_NeoPixel *strip);
+  void              show(void);
+  void              updateClock(void);
+  /*!
+    @brief   Check whether a call to show() will start sending data
+             immediately, i.e. the previous frame has been sent and has
+             had time to latch.
+    @return  true if show() will start sending immediately.
+  */
+  bool canShow(void) {
+    int64_t howlongago = absolute_time_diff_us (endTime, get_absolute_time());
+    return (howlongago >= 300L);
+  }
+  /*!
+    @brief   Check whether the DMA channel is still reading the
+             transposed frame.
+    @return  true while a frame is being streamed out.
+  */
+  bool              isShowing(void) const {
+    return (dma_chan >= 0) && dma_channel_is_busy(dma_chan);
+  }
+  /*!
+    @brief   Return the number of strips attached so far.
+    @return  Strip count, 0 to NEO_PARALLEL_MAX_STRIPS.
+  */
+  uint8_t           numStrips(void) const { return nStrips; }
+
+ protected:
+
+  bool              rp2040Init(void);
+  void              releasePlanes(void);
+  void              transpose(void);
+
+  bool              is800KHz;   ///< true if 800 KHz pixels
+  bool              begun;      ///< true once the state machine has started
+  uint16_t          basePin;    ///< Pin of the first strip
+  uint8_t           nStrips;    ///< Number of strips attached
+  uint16_t          maxBytes;   ///< Longest strip buffer, in bytes
+  uint8_t          *planes;     ///< Bit-transposed frame, 8 bytes per strip byte
+  Adafruit_NeoPixel *strips[NEO_PARALLEL_MAX_STRIPS]; ///< Attached strips
+  absolute_time_t   endTime;    ///< Time the last bit of the frame goes out
+  PIO               pio;        ///< chosen pio for the parallel program
+  int               sm;         ///< chosen state machine; -1 if none available
+  int               offset;     ///< program offset in the chosen pio
+  int               dma_chan;   ///< DMA channel feeding the state machine; -1 if none
+};
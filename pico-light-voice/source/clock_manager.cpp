@@ -0,0 +1,136 @@
+#include "clock_manager.h"
+
+#include <hardware/clocks.h>
+#include <pico/stdlib.h>
+#include <pico/sync.h>
+#include <stdio.h>
+
+typedef struct {
+  clock_change_fn pre, post;
+  void *arg;
+} callback_t;
+
+typedef struct {
+  uint32_t khz;
+  uint64_t us;         // time spent at khz, in total
+} level_t;
+
+static mutex_t clock_mutex;
+static callback_t callbacks[CLOCK_MAX_CALLBACKS];
+static int num_callbacks = 0;
+
+static uint32_t base_khz;
+static level_t levels[CLOCK_MAX_LEVELS];
+static int num_levels = 0;
+static int current = -1;
+static uint64_t since;    // when the current level was entered
+
+// Adds the time since the last change to the current frequency's total
+static void account(uint64_t now) {
+  if (current >= 0) levels[current].us += now - since;
+  since = now;
+}
+
+static int level_for(uint32_t khz) {
+  for (int i = 0; i < num_levels; i++)
+    if (levels[i].khz == khz) return i;
+  // past the last slot, time is added to whichever level came last
+  if (num_levels == CLOCK_MAX_LEVELS) return CLOCK_MAX_LEVELS - 1;
+  levels[num_levels].khz = khz;
+  levels[num_levels].us = 0;
+  return num_levels++;
+}
+
+void clock_manager_init() {
+  mutex_init(&clock_mutex);
+  base_khz = clock_get_hz(clk_sys) / 1000;
+  since = time_us_64();
+  current = level_for(base_khz);
+}
+
+bool clock_manager_register(clock_change_fn pre, clock_change_fn post,
+			    void *arg) {
+  mutex_enter_blocking(&clock_mutex);
+  bool ok = num_callbacks < CLOCK_MAX_CALLBACKS;
+  if (ok) {
+    callbacks[num_callbacks].pre = pre;
+    callbacks[num_callbacks].post = post;
+    callbacks[num_callbacks].arg = arg;
+    num_callbacks++;
+  }
+  mutex_exit(&clock_mutex);
+  return ok;
+}
+
+bool clock_manager_set_khz(uint32_t khz) {
+  uint32_t old_hz = clock_get_hz(clk_sys);
+  if (khz * 1000 == old_hz) return true;
+
+  uint vco, postdiv1, postdiv2;
+  if (!check_sys_clock_khz(khz, &vco, &postdiv1, &postdiv2)) return false;
+
+  mutex_enter_blocking(&clock_mutex);
+  for (int i = 0; i < num_callbacks; i++)
+    if (callbacks[i].pre) callbacks[i].pre(old_hz, khz * 1000, callbacks[i].arg);
+
+  set_sys_clock_khz(khz, true);
+  account(time_us_64());
+  current = level_for(khz);
+
+  for (int i = 0; i < num_callbacks; i++)
+    if (callbacks[i].post) callbacks[i].post(old_hz, khz * 1000, callbacks[i].arg);
+  mutex_exit(&clock_mutex);
+  return true;
+}
+
+void clock_manager_hold() {
+  mutex_enter_blocking(&clock_mutex);
+}
+
+void clock_manager_release() {
+  mutex_exit(&clock_mutex);
+}
+
+// microjoules used in us microseconds at khz, from the current model
+static double energy_uj(uint32_t khz, uint64_t us) {
+  double ua = CLOCK_BASE_UA + CLOCK_UA_PER_MHZ * (khz / 1000.0);
+  return ua * CLOCK_SUPPLY_MV * us * 1e-9;
+}
+
+void clock_manager_report() {
+  account(time_us_64());
+
+  uint64_t total_us = 0;
+  for (int i = 0; i < num_levels; i++) total_us += levels[i].us;
+  if (!total_us) return;
+
+  printf("Clock:");
+  for (int i = 0; i < num_levels; i++)
+    printf(" %lu MHz %llu ms (%d%%)%s", (unsigned long)(levels[i].khz / 1000),
+	   (unsigned long long)(levels[i].us / 1000),
+	   (int)(levels[i].us * 100 / total_us),
+	   i < num_levels - 1 ? "," : "\n");
+
+  // Boosted time is taken to be CPU bound, so it would have needed
+  // proportionally longer at the baseline; time below the baseline is
+  // taken to be spent waiting, which the clock doesn't shorten
+  uint64_t boosted_us = 0;
+  double base_equiv_us = 0;
+  double uj = 0;
+  for (int i = 0; i < num_levels; i++) {
+    uj += energy_uj(levels[i].khz, levels[i].us);
+    if (levels[i].khz > base_khz) {
+      boosted_us += levels[i].us;
+      base_equiv_us += (double)levels[i].us * levels[i].khz / base_khz;
+    }
+  }
+  double base_uj = energy_uj(base_khz, total_us);
+
+  printf("Clock: boosted %llu ms, ~%llu ms at %lu MHz; "
+	 "~%.0f mJ, ~%.0f mJ at %lu MHz (%d%% saved)\n",
+	 (unsigned long long)(boosted_us / 1000),
+	 (unsigned long long)(base_equiv_us / 1000),
+	 (unsigned long)(base_khz / 1000), uj / 1000, base_uj / 1000,
+	 (unsigned long)(base_khz / 1000),
+	 (int)((base_uj - uj) * 100 / base_uj));
+}
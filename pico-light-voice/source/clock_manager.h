@@ -0,0 +1,54 @@
+// Run-time changes of the system clock, for running the model with clk_sys
+// boosted and waiting for samples with it lowered.
+//
+// Peripherals timed from clk_sys have to follow a change. Their owners
+// register callbacks that run just before and just after the PLL moves,
+// with the clock held so the other core can't start anything timed by it
+// in between. Code on the other core holds the clock itself around
+// starting such work (a NeoPixel frame, say).
+//
+// The time spent at each frequency is recorded and reported, with an
+// estimate of the energy used from a simple model of the supply current.
+
+#pragma once
+#include <stdint.h>
+
+#define CLOCK_MAX_CALLBACKS 4
+#define CLOCK_MAX_LEVELS 4       // frequencies with their own time totals
+
+// Supply current model: a fixed part plus a part that grows with clk_sys.
+// Rough figures for a Pico with both cores running; measure the board and
+// override them for real numbers.
+#ifndef CLOCK_SUPPLY_MV
+#define CLOCK_SUPPLY_MV 3300
+#endif
+#ifndef CLOCK_BASE_UA
+#define CLOCK_BASE_UA 5000
+#endif
+#ifndef CLOCK_UA_PER_MHZ
+#define CLOCK_UA_PER_MHZ 150
+#endif
+
+// Called with the clock held, on the core that changes it
+typedef void (*clock_change_fn)(uint32_t old_hz, uint32_t new_hz, void *arg);
+
+// Takes the current clk_sys as the baseline savings are measured against.
+// Call it before the other core is launched.
+void clock_manager_init();
+
+// Either callback may be NULL. Returns false if the table is full.
+bool clock_manager_register(clock_change_fn pre, clock_change_fn post,
+			    void *arg);
+
+// Moves clk_sys to khz once no hold is in place. Returns false, leaving the
+// clock alone, if the PLL can't make khz exactly.
+bool clock_manager_set_khz(uint32_t khz);
+
+// Keeps clk_sys where it is until clock_manager_release()
+void clock_manager_hold();
+void clock_manager_release();
+
+// Prints the time at each frequency since init, how long the boosted time
+// would have taken at the baseline clock, and the energy estimate for both.
+// Call it from the core that changes the clock.
+void clock_manager_report();
@@ -0,0 +1,118 @@
+#include "effects.h"
+#if CLOCK_SCALING
+#include "clock_manager.h"
+#endif
+
+#include <pico/time.h>
+#include <stdio.h>
+
+// Hardware alarm for the frame timer; the default alarm pool (on core 0)
+// uses alarm 3
+#define FRAME_ALARM_NUM 2
+
+static effect_t effects[MAX_EFFECTS];
+static int num_effects = 0;
+
+static Adafruit_NeoPixel *effect_strip;
+static alarm_pool_t *frame_pool;
+static repeating_timer_t frame_timer;
+static volatile bool frame_due = false;
+
+static volatile int requested = -1;
+static int current = -1;
+static frame_t frame;
+static uint64_t start_time;
+
+static bool frame_tick(repeating_timer_t *) {
+  frame_due = true;
+  __sev();
+  return true;
+}
+
+void effects_init(Adafruit_NeoPixel *strip, uint32_t frame_us) {
+  effect_strip = strip;
+  // Creating the pool here puts the alarm IRQ on this core
+  frame_pool = alarm_pool_create(FRAME_ALARM_NUM, 4);
+  // negative delay: period is measured start-to-start
+  alarm_pool_add_repeating_timer_us(frame_pool, -(int64_t)frame_us,
+				    frame_tick, NULL, &frame_timer);
+}
+
+int effects_register(const char *name, render_fn render, bool dithered) {
+  if (num_effects == MAX_EFFECTS) return -1;
+  effect_t *e = &effects[num_effects];
+  e->name = name;
+  e->render = render;
+  e->dithered = dithered;
+  e->frames = 0;
+  e->total_us = 0;
+  e->max_us = 0;
+  return num_effects++;
+}
+
+void effects_select(int index) {
+  if (index >= 0 && index < num_effects) requested = index;
+}
+
+// Start sending the current frame to the strip
+static void send_frame(bool dithered) {
+#if CLOCK_SCALING
+  // the strip's bit rate is set from clk_sys, which mustn't change until
+  // the frame has started; the clock manager waits out the rest of it
+  clock_manager_hold();
+#endif
+  if (dithered) {
+    effect_strip->showDithered();
+  } else {
+    effect_strip->swap();
+  }
+#if CLOCK_SCALING
+  clock_manager_release();
+#endif
+}
+
+void effects_run_frame() {
+  bool dithered = current >= 0 && effects[current].dithered;
+  while (!frame_due) {
+    if (!dithered) {
+      __wfe();
+    } else if (effect_strip->canShow()) {
+      // every refresh moves the dithering on, so send back to back
+      send_frame(true);
+    }
+  }
+  frame_due = false;
+
+  uint64_t now = time_us_64();
+
+  // apply a new selection at the frame boundary
+  if (requested != current) {
+    current = requested;
+    frame.strip = effect_strip;
+    frame.number = 0;
+    start_time = now;
+  }
+  if (current < 0) return;
+
+  effect_t *e = &effects[current];
+  e->render(&frame, (uint32_t)((now - start_time) / 1000));
+  uint32_t cost = (uint32_t)(time_us_64() - now);
+
+  e->frames++;
+  e->total_us += cost;
+  if (cost > e->max_us) e->max_us = cost;
+  frame.number++;
+
+  // a dithered frame goes out with the next refresh
+  if (!e->dithered) send_frame(false);
+}
+
+void effects_print_stats() {
+  for (int i = 0; i < num_effects; i++) {
+    effect_t *e = &effects[i];
+    if (e->frames == 0) continue;
+    printf("Effect %s: %u frames, avg %u us, max %u us\n", e->name,
+	   (unsigned)e->frames, (unsigned)(e->total_us / e->frames),
+	   (unsigned)e->max_us);
+  }
+}
@@ -0,0 +1,50 @@
+// Frame-based lighting effect engine for the lighting core.
+//
+// Effects are registered once and render one frame at a time into the
+// strip's back buffer. A repeating hardware alarm on the calling core
+// paces frames at a fixed rate, and the time each effect spends rendering
+// is recorded so expensive effects are easy to spot.
+//
+// A dithered effect renders 16-bit colour with setPixelColor16() into a
+// strip that has had enableDithering(). Between its frames the strip is
+// refreshed with showDithered() as fast as it takes data, so that levels
+// between two 8-bit steps come out as a mix of both.
+
+#pragma once
+#include <stdint.h>
+#include "Adafruit_NeoPixel.hpp"
+
+#define MAX_EFFECTS 8
+
+typedef struct {
+  Adafruit_NeoPixel *strip;
+  uint32_t number;     // frames rendered since the effect was selected
+} frame_t;
+
+// time_ms is the time since the effect was selected
+typedef void (*render_fn)(frame_t *frame, uint32_t time_ms);
+
+typedef struct {
+  const char *name;
+  render_fn render;
+  bool dithered;       // renders at 16 bits, sent with showDithered()
+  uint32_t frames;     // frames rendered in total
+  uint64_t total_us;   // time spent in render, in total
+  uint32_t max_us;     // longest single render
+} effect_t;
+
+// Start the frame timer on the current core. frame_us is the frame period.
+void effects_init(Adafruit_NeoPixel *strip, uint32_t frame_us);
+
+// Returns the effect's index, or -1 if the table is full
+int effects_register(const char *name, render_fn render,
+		     bool dithered = false);
+
+// Switch effects; takes effect on the next frame
+void effects_select(int index);
+
+// Sleep until the next frame is due, then render and show it. A dithered
+// effect's frame is refreshed instead of sleeping.
+void effects_run_frame();
+
+void effects_print_stats();
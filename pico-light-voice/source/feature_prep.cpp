@@ -0,0 +1,20 @@
+#include "feature_prep.h"
+#include "hot_in_ram.h"
+
+// This math is so slow but it doesn't matter in comparison to the
+// other ML ops?
+void HOT_FUNC(normalize_window)(const uint16_t *in, float *out, uint32_t n) {
+  uint16_t min = 32768;
+  uint16_t max = 0;
+
+  for (uint32_t i=0; i<n; i++) {
+    if (in[i] > max) max = in[i];
+    if (in[i] < min) min = in[i];
+  }
+
+  for (uint32_t i=0; i<n; i++) {
+    float val = ((float)in[i]-(float)min)/((float)max-(float)min)*2-1;
+    val = val*32766;
+    out[i] = val;
+  }
+}
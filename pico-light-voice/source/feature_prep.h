@@ -0,0 +1,23 @@
+// Feature preparation: the window of samples handed to the model.
+//
+// NSAMP new samples arrive per block and the oldest NSAMP are dropped, so
+// the model sees a window of the last INSIZE samples, once per block.
+
+#pragma once
+#include <stdint.h>
+
+// NSAMP is the number of samples collected between each run of the
+// machine learning code. An NSAMP of 1000 at a 4 kHz sample rate
+// means the model will run once every quarter second. As each new
+// batch of NSAMP samples are collected, the last INSIZE-NSAMP samples
+// collected from the previous run are wrapped around to the beginning
+// of the sample buffer, and the next NSAMP samples are added on
+#define NSAMP 1000
+// INSIZE is the input size of the model. In most cases, this should
+// be one second's worth of data, so it should be equal to the sample
+// rate of the ADC.
+#define INSIZE 4000
+
+// Scales n ADC codes to +-32766 between their minimum and maximum, the
+// range the model was trained on
+void normalize_window(const uint16_t *in, float *out, uint32_t n);
@@ -0,0 +1,4 @@
+// _kiss_fft_guts.h has no include guard, so kiss_fft.c and kiss_fftr.c
+// each get a file of their own
+#include "kiss_fft16.h"
+#include "kiss_fft.c"
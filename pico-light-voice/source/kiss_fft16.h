@@ -0,0 +1,17 @@
+// adc_fft's kiss_fft built for 16-bit fixed point, for the log-mel
+// front end. The functions are renamed so this build can be linked next
+// to the float one (and the Edge Impulse SDK's own copy).
+
+#pragma once
+
+#define FIXED_POINT 16
+#define kiss_fft_alloc kiss_fft16_alloc
+#define kiss_fft kiss_fft16
+#define kiss_fft_stride kiss_fft16_stride
+#define kiss_fft_cleanup kiss_fft16_cleanup
+#define kiss_fft_next_fast_size kiss_fft16_next_fast_size
+#define kiss_fftr_alloc kiss_fftr16_alloc
+#define kiss_fftr kiss_fftr16
+#define kiss_fftri kiss_fftri16
+
+#include "kiss_fftr.h"
@@ -0,0 +1,2 @@
+#include "kiss_fft16.h"
+#include "kiss_fftr.c"
@@ -1,10 +1,23 @@
 #include <pico/multicore.h>
 #include <stdio.h>
 #include "Adafruit_NeoPixel.hpp"
+#include "effects.h"
+#if CLOCK_SCALING
+#include "clock_manager.h"
+#endif
 
 #define PIN 7
 #define NUM_STATES 3
 #define NUM_LIGHTS 60
+// 100 frames per second
+#define FRAME_US 10000
+
+// Position of each pixel around the colour wheel, and the wheel colours
+static uint8_t phase[NUM_LIGHTS];
+static uint32_t wheel[256];
+
+static int effect_off;
+static int effect_for_state[NUM_STATES];
 
 bool update_state(uint32_t *state, bool strip_on) {
   // check for new state information
@@ -38,11 +51,163 @@ bool update_state(uint32_t *state, bool strip_on) {
   return strip_on;
 }
 
+void init_tables() {
+  for (uint16_t i = 0; i < NUM_LIGHTS; i++) {
+    phase[i] = i * 256 / NUM_LIGHTS;
+  }
+
+  for (uint16_t i = 0; i < 256; i++) {
+    uint8_t WheelPos = 255 - i;
+
+    if(WheelPos < 85) {
+      wheel[i] = Adafruit_NeoPixel::Color(255 - WheelPos * 3, 0, WheelPos * 3);
+    }
+
+    else if(WheelPos < 170) {
+      WheelPos -= 85;
+      wheel[i] = Adafruit_NeoPixel::Color(0, WheelPos * 3, 255 - WheelPos * 3);
+    }
+
+    else {
+      WheelPos -= 170;
+      wheel[i] = Adafruit_NeoPixel::Color(WheelPos * 3, 255 - WheelPos * 3, 0);
+    }
+  }
+}
+
+void render_off(frame_t *frame, uint32_t) {
+  frame->strip->clear();
+}
+
+// rainbow state
+void render_rainbow(frame_t *frame, uint32_t time_ms) {
+  // one step around the wheel every 10 ms
+  uint8_t step = time_ms / 10;
+
+  for (uint16_t i = 0; i < NUM_LIGHTS; i++) {
+    frame->strip->setPixelColor(i, wheel[(uint8_t)(phase[i] + step)]);
+  }
+}
+
+// The wheel at 16 bits, with pos running once round it; the same colours
+// as the wheel table, which has 256 steps of pos
+static void wheel16(uint16_t pos, uint16_t *r, uint16_t *g, uint16_t *b) {
+  uint32_t p = (uint16_t)~pos * 3u;
+  uint16_t up = p & 0xffff;
+  uint16_t down = 0xffff - up;
+
+  switch (p >> 16) {
+  case 0: *r = down; *g = 0;    *b = up;   break;
+  case 1: *r = 0;    *g = up;   *b = down; break;
+  default: *r = up;  *g = down; *b = 0;    break;
+  }
+}
+
+// rainbow state, dithered. A step of the wheel table is 3 levels, which
+// at brightness 64 is under one level of the 8-bit output, so
+// render_rainbow moves in uneven jumps; this one moves smoothly.
+void render_rainbow16(frame_t *frame, uint32_t time_ms) {
+  // 256ths of a wheel table step, at the same speed as render_rainbow,
+  // which goes round once every 2560 ms
+  uint16_t step = (time_ms % 2560) * 256 / 10;
+
+  for (uint16_t i = 0; i < NUM_LIGHTS; i++) {
+    uint16_t r, g, b;
+    wheel16((phase[i] << 8) + step, &r, &g, &b);
+    frame->strip->setPixelColor16(i, r, g, b);
+  }
+}
+
+// boring
+void render_warm(frame_t *frame, uint32_t) {
+  frame->strip->fill(Adafruit_NeoPixel::Color(10,10,5));
+}
+
+// boring
+void render_green(frame_t *frame, uint32_t) {
+  frame->strip->fill(Adafruit_NeoPixel::Color(10,50,5));
+}
+
+#if DITHER_BENCHMARK
+// Refresh rate of the dithered output loop for a strip of n pixels, and the
+// time showDithered() takes on the CPU (16 to 8 bit conversion and starting
+// the DMA) once the strip is ready for the next frame
+void dither_benchmark(uint16_t n) {
+  Adafruit_NeoPixel strip = Adafruit_NeoPixel(n, PIN, NEO_GRB + NEO_KHZ800);
+  strip.begin();
+  strip.setBrightness(64);
+  if (!strip.enableDithering()) {
+    printf("dither %d px: not enough pixel pool memory\n", n);
+    return;
+  }
+
+  // a slow ramp, where 8-bit steps are easiest to see
+  for (uint16_t i = 0; i < n; i++) {
+    uint16_t v = i * (0x2000 / n);
+    strip.setPixelColor16(i, v, v, v);
+  }
+
+  uint32_t frames = 0;
+  uint64_t busy_us = 0;
+  absolute_time_t end = make_timeout_time_ms(1000);
+  while (absolute_time_diff_us(get_absolute_time(), end) > 0) {
+    while (!strip.canShow());
+    absolute_time_t t0 = get_absolute_time();
+    strip.showDithered();
+    busy_us += absolute_time_diff_us(t0, get_absolute_time());
+    frames++;
+  }
+  while (strip.isShowing());
+
+  printf("dither %d px: %lu frames/s, %llu us per frame on the CPU\n",
+	 n, (unsigned long)frames, (unsigned long long)(busy_us / frames));
+}
+#endif
+
+#if CLOCK_SCALING
+// Both run on core 0 with the clock held, so no new frame can start. The
+// frame on the wire has to finish and latch at the old bit rate first.
+static void strip_clock_pre(uint32_t, uint32_t, void *arg) {
+  Adafruit_NeoPixel *strip = (Adafruit_NeoPixel *)arg;
+  while (!strip->canShow()) tight_loop_contents();
+}
+
+static void strip_clock_post(uint32_t, uint32_t, void *arg) {
+  ((Adafruit_NeoPixel *)arg)->updateClock();
+}
+#endif
+
 void core1_entry() {
+#if DITHER_BENCHMARK
+  dither_benchmark(60);
+  dither_benchmark(300);
+#endif
+
   Adafruit_NeoPixel strip = Adafruit_NeoPixel(NUM_LIGHTS, PIN,
 					      NEO_GRB + NEO_KHZ800);
   strip.begin();
   strip.setBrightness(64);
+  // unchanged frames are not resent, apart from a once-a-second refresh
+  strip.setKeepAlive(1000);
+#if CLOCK_SCALING
+  clock_manager_register(strip_clock_pre, strip_clock_post, &strip);
+#endif
+
+  init_tables();
+  effect_off = effects_register("off", render_off);
+  // 60 pixels take about 2.5 ms to send and latch, so the dithered rainbow
+  // is refreshed about 400 times a second (see DITHER_BENCHMARK), four
+  // times per frame. Without the pool space for it, it steps as before.
+  if (strip.enableDithering()) {
+    effect_for_state[0] = effects_register("rainbow", render_rainbow16, true);
+  } else {
+    effect_for_state[0] = effects_register("rainbow", render_rainbow);
+  }
+  effect_for_state[1] = effects_register("warm", render_warm);
+  effect_for_state[2] = effects_register("green", render_green);
+
+  effects_init(&strip, FRAME_US);
+  effects_select(effect_off);
   
   // tell the other core we're ready for data
   multicore_fifo_push_blocking(0);
@@ -51,70 +216,16 @@ void core1_entry() {
   bool lights_on = false;
   
   while (1) {
+    uint32_t last_state = state;
+    bool was_on = lights_on;
     lights_on = update_state(&state, lights_on);
 
-    if (!lights_on) {
-      strip.clear();
-      strip.show();
-      sleep_ms(200);
-    }
-    
-    // rainbow state
-    else if (state == 0) {
-      uint16_t i, j;
-
-      for(j=0; j<256; j++) {
-	for(i=0; i< strip.numPixels(); i++) {
-	  uint8_t WheelPos = ((i * 256 / strip.numPixels()) + j) & 255;
-	  uint32_t c = 0;
-
-	  WheelPos = 255 - WheelPos;
-	  
-	  if(WheelPos < 85) {
-	    c = strip.Color(255 - WheelPos * 3, 0, WheelPos * 3);
-	  }
-	  
-	  else if(WheelPos < 170) {
-	    WheelPos -= 85;
-	    c = strip.Color(0, WheelPos * 3, 255 - WheelPos * 3);
-	  }
-	  
-	  else {
-	    WheelPos -= 170;
-	    c = strip.Color(WheelPos * 3, 255 - WheelPos * 3, 0);
-	  }
-      
-	  strip.setPixelColor(i, c);
-	}
-
-	// check if state has changed
-	uint32_t last_state = state;
-	lights_on = update_state(&state, lights_on);
-	if (last_state != state || !lights_on) break;
-    
-	strip.show();
-	sleep_ms(10);
-      }
-    }
-
-    // boring
-    else if (state == 1) {
-      for(int i=0; i< strip.numPixels(); i++) {
-	strip.setPixelColor(i, strip.Color(10,10,5));
-      }
-
-      strip.show();
-      sleep_ms(100);
+    // new state is picked up by the next frame
+    if (lights_on != was_on || state != last_state) {
+      effects_print_stats();
+      effects_select(lights_on ? effect_for_state[state] : effect_off);
     }
 
-    // boring
-    else if (state == 2) {
-      for(int i=0; i< strip.numPixels(); i++) {
-	strip.setPixelColor(i, strip.Color(10,50,5));
-      }
-
-      strip.show();
-      sleep_ms(100);
-    }
+    effects_run_frame();
   }
 }
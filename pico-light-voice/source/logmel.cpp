@@ -0,0 +1,178 @@
+#include "logmel.h"
+
+#include <math.h>
+#include <string.h>
+#include "kiss_fft16.h"
+
+#define LOG2_FFT_N 8
+#define BINS (LOGMEL_FFT_N/2 + 1)
+// each bin is in at most two triangles, and a filter narrower than a bin
+// gets one of its own
+#define MAX_WEIGHTS (2*BINS + LOGMEL_FILTERS)
+#define PLAN_BYTES 2048
+
+static int16_t window[LOGMEL_FRAME_LEN];  // Q15
+static kiss_fftr_cfg plan;
+static uint8_t plan_mem[PLAN_BYTES] __attribute__((aligned(8)));
+
+// Filter f covers fb_len[f] bins from fb_start[f], with its weights
+// (Q15) from fb_weights[fb_offset[f]]
+static uint8_t fb_start[LOGMEL_FILTERS];
+static uint8_t fb_len[LOGMEL_FILTERS];
+static uint16_t fb_offset[LOGMEL_FILTERS];
+static uint16_t fb_weights[MAX_WEIGHTS];
+
+static int16_t dct[LOGMEL_CEPS][LOGMEL_FILTERS]; // Q15
+
+static kiss_fft_scalar frame[LOGMEL_FFT_N];
+static kiss_fft_cpx spec[BINS];
+static uint32_t power[BINS];
+
+static float hz_to_mel(float hz) { return 2595 * log10f(1 + hz / 700); }
+static float mel_to_hz(float mel) { return 700 * (powf(10, mel / 2595) - 1); }
+
+bool logmel_init(uint32_t sample_rate, float low_hz, float high_hz) {
+  if (low_hz < 0 || high_hz <= low_hz || high_hz > sample_rate / 2.0f)
+    return false;
+
+  size_t len = sizeof(plan_mem);
+  plan = kiss_fftr_alloc(LOGMEL_FFT_N, false, plan_mem, &len);
+  if (!plan) return false;
+
+  for (int i = 0; i < LOGMEL_FRAME_LEN; i++) {
+    float w = 0.5f - 0.5f * cosf(2 * (float)M_PI * i / LOGMEL_FRAME_LEN);
+    window[i] = w >= 1 ? 32767 : (int16_t)lroundf(w * 32768);
+  }
+  // the zero padding is never written after this
+  memset(frame, 0, sizeof(frame));
+
+  // Triangles between equally spaced points on the mel scale, each
+  // peaking where the next one starts
+  float mel_lo = hz_to_mel(low_hz);
+  float mel_hi = hz_to_mel(high_hz);
+  float edge[LOGMEL_FILTERS + 2];
+  for (int i = 0; i < LOGMEL_FILTERS + 2; i++)
+    edge[i] = mel_to_hz(mel_lo + (mel_hi - mel_lo) * i / (LOGMEL_FILTERS + 1));
+
+  float bin_hz = (float)sample_rate / LOGMEL_FFT_N;
+  uint32_t used = 0;
+  for (int f = 0; f < LOGMEL_FILTERS; f++) {
+    float lo = edge[f], mid = edge[f+1], hi = edge[f+2];
+    fb_offset[f] = used;
+    fb_start[f] = 0;
+    fb_len[f] = 0;
+
+    int last = (int)(hi / bin_hz);
+    if (last > BINS - 1) last = BINS - 1;
+    for (int k = (int)ceilf(lo / bin_hz); k <= last; k++) {
+      float hz = k * bin_hz;
+      float w = hz <= mid ? (hz - lo) / (mid - lo) : (hi - hz) / (hi - mid);
+      if (w <= 0 || used == MAX_WEIGHTS) continue;
+      if (!fb_len[f]) fb_start[f] = k;
+      fb_weights[used++] = (uint16_t)lroundf(w * 32768);
+      fb_len[f]++;
+    }
+
+    // a filter narrower than a bin takes the bin nearest its centre
+    if (!fb_len[f] && used < MAX_WEIGHTS) {
+      fb_start[f] = (uint8_t)lroundf(mid / bin_hz);
+      fb_weights[used++] = 32768;
+      fb_len[f] = 1;
+    }
+  }
+
+  // orthonormal DCT-II
+  for (int c = 0; c < LOGMEL_CEPS; c++) {
+    float scale = sqrtf((c ? 2.0f : 1.0f) / LOGMEL_FILTERS);
+    for (int f = 0; f < LOGMEL_FILTERS; f++) {
+      float d = scale * cosf((float)M_PI * c * (f + 0.5f) / LOGMEL_FILTERS);
+      dct[c][f] = (int16_t)lroundf(d * 32767);
+    }
+  }
+  return true;
+}
+
+// log2(x) with LOGMEL_Q fractional bits: the position of the top bit,
+// plus log2(1+m) ~ m + 0.3466 m (1 - m) for the 16 bits m below it,
+// which is good to about 0.01
+static int32_t log2_q(uint64_t x) {
+  if (x <= 1) return 0;
+  int n = 63 - __builtin_clzll(x);
+  uint32_t m = n >= 16 ? (uint32_t)(x >> (n - 16)) : (uint32_t)(x << (16 - n));
+  m &= 0xffff;
+  uint32_t corr = (uint32_t)(((uint64_t)m * (65536 - m)) >> 16) * 22713 >> 16;
+  return (n << LOGMEL_Q) + ((m + corr) >> (16 - LOGMEL_Q));
+}
+
+uint32_t logmel_compute(const uint16_t *samples, uint32_t nsamp,
+			int16_t *out) {
+  if (nsamp < LOGMEL_FRAME_LEN) return 0;
+  uint32_t frames = LOGMEL_FRAMES(nsamp);
+
+  for (uint32_t t = 0; t < frames; t++) {
+    const uint16_t *s = samples + t * LOGMEL_FRAME_STRIDE;
+
+    // the frame's mean, and its largest swing about it
+    int32_t sum = 0;
+    for (int i = 0; i < LOGMEL_FRAME_LEN; i++) sum += s[i];
+    int32_t mean = sum / LOGMEL_FRAME_LEN;
+    int32_t peak = 0;
+    for (int i = 0; i < LOGMEL_FRAME_LEN; i++) {
+      int32_t d = s[i] - mean;
+      if (d < 0) d = -d;
+      if (d > peak) peak = d;
+    }
+
+    // block floating point: scale the frame up to fill 16 bits, so
+    // quiet frames keep their resolution through the FFT
+    int shift = 0;
+    while (shift < 15 && (peak << (shift + 1)) <= 32767) shift++;
+    for (int i = 0; i < LOGMEL_FRAME_LEN; i++)
+      frame[i] = ((s[i] - mean) * (1 << shift) * window[i]) >> 15;
+
+    kiss_fftr(plan, frame, spec);
+    for (int k = 0; k < BINS; k++)
+      power[k] = (uint32_t)(spec[k].r * spec[k].r) +
+	(uint32_t)(spec[k].i * spec[k].i);
+
+    // back to the frame's own units: the FFT scaled by 1/N, the frame was
+    // scaled up by 2^shift and the weights are Q15
+    int32_t offset = (2 * LOG2_FFT_N - 2 * shift - 15) << LOGMEL_Q;
+    int16_t *row = out + t * LOGMEL_FILTERS;
+    for (int f = 0; f < LOGMEL_FILTERS; f++) {
+      const uint16_t *w = &fb_weights[fb_offset[f]];
+      const uint32_t *p = &power[fb_start[f]];
+      uint64_t acc = 0;
+      for (int k = 0; k < fb_len[f]; k++) acc += (uint64_t)w[k] * p[k];
+      row[f] = log2_q(acc) + offset;
+    }
+  }
+  return frames;
+}
+
+void logmel_quantize(const int16_t *logmel, uint32_t n, int8_t *out) {
+  // 10 log10(2) dB per unit of log2
+  const int32_t range = (int32_t)(LOGMEL_RANGE_DB / 3.0103f * (1 << LOGMEL_Q));
+  const int32_t scale = (255 << 16) / range;
+
+  int32_t top = INT16_MIN;
+  for (uint32_t i = 0; i < n; i++) if (logmel[i] > top) top = logmel[i];
+
+  int32_t floor = top - range;
+  for (uint32_t i = 0; i < n; i++) {
+    int32_t v = logmel[i] - floor;
+    if (v < 0) v = 0;
+    out[i] = (int8_t)(((v * scale) >> 16) - 128);
+  }
+}
+
+void logmel_mfcc(const int16_t *logmel, uint32_t frames, int16_t *out) {
+  for (uint32_t t = 0; t < frames; t++) {
+    const int16_t *row = logmel + t * LOGMEL_FILTERS;
+    for (int c = 0; c < LOGMEL_CEPS; c++) {
+      int64_t acc = 0;
+      for (int f = 0; f < LOGMEL_FILTERS; f++) acc += dct[c][f] * row[f];
+      out[t * LOGMEL_CEPS + c] = (int16_t)(acc >> 15);
+    }
+  }
+}
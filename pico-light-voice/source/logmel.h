@@ -0,0 +1,43 @@
+// Fixed-point log-mel and MFCC front end.
+//
+// A window of ADC samples is cut into overlapping frames. Each frame is
+// Hann windowed, scaled up to use the full 16 bits (block floating
+// point), and put through a 16-bit fixed-point real FFT. Mel filter
+// energies come from a sparse filterbank, and their logs from a fast
+// base-2 approximation. One FFT plan and filterbank serve every frame.
+// Nothing on the per-frame path uses floating point.
+
+#pragma once
+#include <stdint.h>
+
+#define LOGMEL_FRAME_LEN 128     // 32 ms at 4 kHz
+#define LOGMEL_FRAME_STRIDE 64
+#define LOGMEL_FFT_N 256         // frames are zero padded to this
+#define LOGMEL_FILTERS 32
+#define LOGMEL_CEPS 13           // MFCCs kept per frame
+#define LOGMEL_Q 8               // fractional bits of the log2 outputs
+#define LOGMEL_RANGE_DB 60       // dynamic range kept by logmel_quantize
+
+// frames in a window of nsamp samples
+#define LOGMEL_FRAMES(nsamp) \
+  (((nsamp) - LOGMEL_FRAME_LEN) / LOGMEL_FRAME_STRIDE + 1)
+
+// Builds the window, FFT plan, filterbank and DCT for a sample rate and a
+// band to cover. Returns false if the band doesn't fit the sample rate.
+// Uses floating point, so call it once at startup.
+bool logmel_init(uint32_t sample_rate, float low_hz, float high_hz);
+
+// Log-mel energies of a window of raw 12-bit ADC samples, as
+// LOGMEL_FRAMES(nsamp) rows of LOGMEL_FILTERS. Each is log2 of the filter
+// energy in ADC codes squared, with LOGMEL_Q fractional bits. Returns the
+// number of frames.
+uint32_t logmel_compute(const uint16_t *samples, uint32_t nsamp,
+			int16_t *out);
+
+// Rescales n log-mel energies to int8 over the LOGMEL_RANGE_DB below the
+// loudest of them; anything quieter is -128.
+void logmel_quantize(const int16_t *logmel, uint32_t n, int8_t *out);
+
+// MFCCs of log-mel rows: LOGMEL_CEPS per frame, with LOGMEL_Q fractional
+// bits
+void logmel_mfcc(const int16_t *logmel, uint32_t frames, int16_t *out);
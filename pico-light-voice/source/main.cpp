@@ -1,10 +1,22 @@
 #include "ei_run_classifier.h"
+#include "feature_prep.h"
 #include "lights.h"
+#include "memory_report.h"
+#include "block_desc.h"
+#include "Adafruit_NeoPixel.hpp"
+#if LOGMEL_TIMING
+#include "logmel.h"
+#endif
+#if CLOCK_SCALING
+#include "clock_manager.h"
+#include <hardware/clocks.h>
+#endif
 
 #include <hardware/gpio.h>
 #include <hardware/uart.h>
 #include <hardware/adc.h>
 #include <hardware/dma.h>
+#include <hardware/irq.h>
 #include <pico/stdio_usb.h>
 #include <pico/stdlib.h>
 #include <pico/multicore.h>
@@ -12,18 +24,6 @@
 
 // ############ ADC and Model Stuff ############
 
-// NSAMP is the number of samples collected between each run of the
-// machine learning code. An NSAMP of 1000 at a 4 kHz sample rate
-// means the model will run once every quarter second. As each new
-// batch of NSAMP samples are collected, the last INSIZE-NSAMP samples
-// collected from the previous run are wrapped around to the beginning
-// of the sample buffer, and the next NSAMP samples are added on
-#define NSAMP 1000
-// INSIZE is the input size of the model. In most cases, this should
-// be one second's worth of data, so it should be equal to the sample
-// rate of the ADC.
-#define INSIZE 4000
-
 // set this to determine sample rate
 // 0     = 500,000 Hz
 // 960   = 50,000 Hz
@@ -39,11 +39,46 @@
 // cooldown time for activating start
 #define COOLDOWN_US 1000000
 
+#if CLOCK_SCALING
+// clk_sys while the model runs, and while waiting for the next block of
+// samples. Both must be frequencies the PLL makes exactly (see
+// check_sys_clock_khz). Much above 200 MHz the core voltage has to be
+// raised too, and flash is clocked at half of clk_sys.
+#define BOOST_KHZ 200000
+#define IDLE_KHZ 48000
+// inferences between clock reports, 10 s at NSAMP 1000
+#define CLOCK_REPORT_EVERY 40
+#endif
+
 float features[INSIZE];
 uint16_t capture_buf[NSAMP];
 uint16_t intermediate_buf[INSIZE];
 uint64_t last_on_time = 0;
 
+#if LOGMEL_TIMING
+// the native front end's features for the window the model just saw;
+// only computed to time them against the SDK's DSP block
+int16_t logmel[LOGMEL_FRAMES(INSIZE) * LOGMEL_FILTERS];
+int8_t logmel_q[LOGMEL_FRAMES(INSIZE) * LOGMEL_FILTERS];
+#endif
+
+uint dma_chan;
+
+void dma_handler() {
+  dma_channel_acknowledge_irq0(dma_chan);
+  block_completed(NSAMP);
+}
+
+#if CLOCK_SCALING
+// The ADC runs from the USB PLL, which clock changes leave alone, so the
+// sample rate doesn't follow clk_sys. Put it back if anything moved it.
+static void adc_clock_post(uint32_t, uint32_t, void *) {
+  if (clock_get_hz(clk_adc) != 48 * MHZ)
+    clock_configure(clk_adc, 0, CLOCKS_CLK_ADC_CTRL_AUXSRC_VALUE_CLKSRC_PLL_USB,
+		    48 * MHZ, 48 * MHZ);
+}
+#endif
+
 // ############ Functions ############
 int raw_feature_get_data(size_t offset, size_t length, float *out_ptr) {
   memcpy(out_ptr, features + offset, length * sizeof(float));
@@ -52,10 +87,17 @@ int raw_feature_get_data(size_t offset, size_t length, float *out_ptr) {
 
 int main()
 {
+  memory_paint_stack0();
   stdio_usb_init();
   stdio_init_all();
+#if CLOCK_SCALING
+  // before core1 starts, as it registers the strip's callbacks
+  clock_manager_init();
+  clock_manager_register(NULL, adc_clock_post, NULL);
+#endif
 
   // Launch lighting core - function lives in lights.cpp
+  memory_paint_stack1();
   multicore_launch_core1(core1_entry);
 
   gpio_init(LED_PIN);
@@ -73,6 +115,11 @@ int main()
     }
   }
 
+#if LOGMEL_TIMING
+  // INSIZE samples is one second, so it is also the sample rate
+  logmel_init(INSIZE, 0, INSIZE / 2);
+#endif
+
   adc_gpio_init(26 + CAPTURE_CHANNEL);
   adc_init();
   adc_select_input(CAPTURE_CHANNEL);
@@ -88,8 +135,22 @@ int main()
   adc_set_clkdiv(CLOCK_DIV);
 
   sleep_ms(1000);
+
+  const mem_buffer_t buffers[] = {
+    MEM_BUFFER(features, 0),
+    MEM_BUFFER(capture_buf, 0),
+    MEM_BUFFER(intermediate_buf, 0),
+#if LOGMEL_TIMING
+    MEM_BUFFER(logmel, 0),
+    MEM_BUFFER(logmel_q, 0),
+#endif
+    // the NeoPixel library's static pixel buffers
+    { "neopixel_pool", NEOPIXEL_POOL_BYTES, 1 },
+  };
+  memory_report_layout(buffers, sizeof(buffers) / sizeof(buffers[0]));
+
   // Set up the DMA to start xfer data as soon as it appears in FIFO
-  uint dma_chan = dma_claim_unused_channel(true);
+  dma_chan = dma_claim_unused_channel(true);
   dma_channel_config cfg = dma_channel_get_default_config(dma_chan);
 
   // Reading from constant address, writing to incrementing byte address
@@ -99,6 +160,18 @@ int main()
 
   // Pace transfers based on availability of ADC samples
   channel_config_set_dreq(&cfg, DREQ_ADC);
+
+  // DMA_IRQ_1 belongs to the NeoPixel library on core1
+  dma_channel_set_irq0_enabled(dma_chan, true);
+  irq_set_exclusive_handler(DMA_IRQ_0, dma_handler);
+  irq_set_enabled(DMA_IRQ_0, true);
+
+  // descriptor of the newest block in intermediate_buf. Detections
+  // print its first sample and how long ago it was captured
+  block_desc block = {0, 0, 0};
+#if CLOCK_SCALING
+  uint32_t inferences = 0;
+#endif
   
   while (true) {
     adc_fifo_drain();
@@ -114,21 +187,13 @@ int main()
     gpio_put(LED_PIN, 1);
     adc_run(true);
 
-    // copy everything to feature buffer. This math is so slow but
-    // it doesn't matter in comparison to the other ML ops?
-    uint16_t min = 32768;
-    uint16_t max = 0;
+#if CLOCK_SCALING
+    // sampling is timed from clk_adc, so it carries on through the change
+    clock_manager_set_khz(BOOST_KHZ);
+#endif
 
-    for (uint32_t i=0; i<INSIZE; i++) {
-      if (intermediate_buf[i] > max) max = intermediate_buf[i];
-      if (intermediate_buf[i] < min) min = intermediate_buf[i];
-    }
-    
-    for (uint32_t i=0; i<INSIZE; i++) {
-      float val = ((float)intermediate_buf[i]-(float)min)/((float)max-(float)min)*2-1;
-      val = val*32766;
-      features[i] = val;
-    }
+    // copy everything to feature buffer
+    normalize_window(intermediate_buf, features, INSIZE);
     
     // invoke the impulse
     EI_IMPULSE_ERROR res = run_classifier(&features_signal, &result,
@@ -148,7 +213,9 @@ int main()
       // activate only if it's above the threshold and cooldown is over
       if (ix == 2 && result.classification[ix].value > thresh &&
 	  time_us_64()-last_on_time>COOLDOWN_US) {
-	printf("START\n");
+	printf("START (sample %llu, %llu us)\n",
+	       (unsigned long long)block.first_sample,
+	       (unsigned long long)(time_us_64() - block.timestamp_us));
 	last_on_time = time_us_64();
 	// Set the result to 1 for the keyword you use to turn the
 	// lights on and or change the lighting state
@@ -156,7 +223,9 @@ int main()
       }
       
       if (ix == 3 && result.classification[ix].value > thresh) {
-	printf("STOP\n");
+	printf("STOP (sample %llu, %llu us)\n",
+	       (unsigned long long)block.first_sample,
+	       (unsigned long long)(time_us_64() - block.timestamp_us));
 	// Set the result to 2 for the keyword that turns off the lights
 	model_result = 2;
       }
@@ -165,6 +234,15 @@ int main()
     }
 
     printf("\n");
+    memory_report_usage(false);
+
+#if LOGMEL_TIMING
+    uint64_t logmel_start = time_us_64();
+    uint32_t frames = logmel_compute(intermediate_buf, INSIZE, logmel);
+    logmel_quantize(logmel, frames * LOGMEL_FILTERS, logmel_q);
+    printf("DSP: SDK %d ms, native %llu us\n", (int)result.timing.dsp,
+	   (unsigned long long)(time_us_64() - logmel_start));
+#endif
 
     // If the lighting core wants a state update, and there's a state
     // update to give, then we'll send it over.
@@ -179,7 +257,14 @@ int main()
     // is data loss between inferencing windows. See the tutorial for 
     // this project for more information.
     gpio_put(LED_PIN, 0);
+#if CLOCK_SCALING
+    if (++inferences % CLOCK_REPORT_EVERY == 0) clock_manager_report();
+    // the copy below runs at this clock too: a change there can wait on a
+    // NeoPixel frame, and would cost more of the gap than it saves
+    clock_manager_set_khz(IDLE_KHZ);
+#endif
     dma_channel_wait_for_finish_blocking(dma_chan);
+    block = block_latest();
 
     // We want to be really quick here, otherwise we'll lose lots of
     // audio between when we stopped sampling and when we start the next
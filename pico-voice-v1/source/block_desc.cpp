@@ -0,0 +1,21 @@
+#include "block_desc.h"
+
+#include <pico/stdlib.h>
+
+static volatile block_desc last_block;
+static uint64_t samples_taken;
+
+void block_completed(uint32_t count) {
+  last_block.timestamp_us = time_us_64();
+  last_block.first_sample = samples_taken;
+  last_block.count = count;
+  samples_taken += count;
+}
+
+block_desc block_latest() {
+  block_desc block;
+  block.timestamp_us = last_block.timestamp_us;
+  block.first_sample = last_block.first_sample;
+  block.count = last_block.count;
+  return block;
+}
@@ -0,0 +1,25 @@
+// Where each DMA block sits in the sample stream, shared by the programs
+// that capture in blocks.
+//
+// The completion interrupt records each block as it completes, and the
+// main loop takes the latest one along with the samples it copies out.
+// The voice programs use it to tell how long after a block was captured
+// the model's verdict on it came out; pico-daq sends it with each block,
+// so when one block completes more than count samples' worth of time
+// after the last, the receiver knows the difference was lost.
+
+#pragma once
+#include <stdint.h>
+
+struct block_desc {
+  uint64_t timestamp_us; // time_us_64() when the block completed
+  uint64_t first_sample; // running index of the block's first sample
+  uint32_t count;        // samples in the block
+};
+
+// Records a block of count samples as completed now. Call it from the
+// completion interrupt.
+void block_completed(uint32_t count);
+
+// The most recently completed block
+block_desc block_latest();
@@ -0,0 +1,136 @@
+#include "decimator.h"
+
+#include <math.h>
+
+// 12-bit ADC input, so CIC_ORDER*log2(cic_r) + 12 bits have to fit in the
+// 32-bit integrators
+#define ADC_MID 2048
+#define MAX_CIC_R 64
+// the FIR's cutoff as a fraction of the output Nyquist frequency; the
+// Blackman window's transition band sits either side of it
+#define CUTOFF 0.8f
+#define DESIGN_GRID 256
+
+// magnitude of the CIC response, f in cycles per CIC output sample
+static float cic_response(float f, uint32_t r) {
+  if (f == 0) return 1;
+  float h = sinf((float)M_PI*f) / (r * sinf((float)M_PI*f / r));
+  return fabsf(h*h*h);
+}
+
+bool decimator_init(decimator_t *d, uint32_t cic_r, uint32_t fir_r,
+		    uint32_t taps_per_phase) {
+  if (cic_r < 2 || cic_r > MAX_CIC_R) return false;
+  if (fir_r < 1 || fir_r > DECIM_MAX_PHASES) return false;
+  if (taps_per_phase < 1 || taps_per_phase > DECIM_MAX_TAPS_PER_PHASE)
+    return false;
+
+  d->cic_r = cic_r;
+  d->fir_r = fir_r;
+  d->taps = taps_per_phase;
+
+  // scale the CIC output (gain cic_r^3) to just under 16 bits
+  float cic_gain = (float)cic_r * cic_r * cic_r;
+  d->shift = (int)ceilf(log2f(ADC_MID * cic_gain)) - 15;
+  if (d->shift < 0) d->shift = 0;
+
+  // Windowed frequency-sampling design: the inverse of the CIC droop up
+  // to the cutoff, nothing above it
+  uint32_t len = fir_r * taps_per_phase;
+  float proto[DECIM_MAX_PHASES * DECIM_MAX_TAPS_PER_PHASE];
+  float fc = CUTOFF * 0.5f / fir_r;
+  float centre = (len - 1) / 2.0f;
+  float dc = 0;
+
+  for (uint32_t n = 0; n < len; n++) {
+    float sum = 0;
+    for (int k = 0; k < DESIGN_GRID; k++) {
+      float f = (k + 0.5f) * fc / DESIGN_GRID;
+      sum += cosf(2*(float)M_PI*f*(n - centre)) / cic_response(f, cic_r);
+    }
+    float w = 1;
+    if (len > 1) {
+      float a = 2*(float)M_PI*n/(len - 1);
+      w = 0.42f - 0.5f*cosf(a) + 0.08f*cosf(2*a);
+    }
+    proto[n] = 2 * sum * fc / DESIGN_GRID * w;
+    dc += proto[n];
+  }
+
+  // DC gain that turns the shifted CIC output into DECIM_FRAC_BITS
+  // fractional bits of ADC code
+  float gain = (1 << DECIM_FRAC_BITS) * (float)(1 << d->shift) / cic_gain;
+  for (uint32_t p = 0; p < fir_r; p++)
+    for (uint32_t j = 0; j < taps_per_phase; j++)
+      d->coef[p][j] = (int16_t)lroundf(proto[p + j*fir_r] / dc * gain * 32768);
+
+  for (int k = 0; k < DECIM_CIC_ORDER; k++) {
+    d->integ[k] = 0;
+    d->comb[k] = 0;
+  }
+  d->cic_count = 0;
+  for (uint32_t p = 0; p < DECIM_MAX_PHASES; p++)
+    for (uint32_t j = 0; j < 2*DECIM_MAX_TAPS_PER_PHASE; j++)
+      d->hist[p][j] = 0;
+  d->pos = 0;
+  d->phase = fir_r - 1;
+  return true;
+}
+
+// Feeds one CIC output to the FIR. Samples are dealt to the phases from
+// fir_r-1 down to 0, and an output is due once phase 0 has its sample.
+static inline bool fir_push(decimator_t *d, int16_t x, int16_t *out) {
+  uint32_t p = d->phase;
+  d->hist[p][d->pos] = x;
+  d->hist[p][d->pos + d->taps] = x;
+  if (p) {
+    d->phase = p - 1;
+    return false;
+  }
+
+  int32_t acc = 0;
+  for (uint32_t q = 0; q < d->fir_r; q++) {
+    const int16_t *h = d->coef[q];
+    const int16_t *line = &d->hist[q][d->pos];
+    for (uint32_t j = 0; j < d->taps; j++) acc += h[j] * line[j];
+  }
+  d->phase = d->fir_r - 1;
+  d->pos = d->pos ? d->pos - 1 : d->taps - 1;
+
+  acc = (acc + (1 << 14)) >> 15;
+  if (acc > INT16_MAX) acc = INT16_MAX;
+  if (acc < INT16_MIN) acc = INT16_MIN;
+  *out = acc;
+  return true;
+}
+
+uint32_t decimator_process(decimator_t *d, const uint16_t *in, uint32_t n,
+			   int16_t *out) {
+  uint32_t i0 = d->integ[0], i1 = d->integ[1], i2 = d->integ[2];
+  uint32_t count = d->cic_count;
+  uint32_t written = 0;
+
+  for (uint32_t i = 0; i < n; i++) {
+    i0 += (uint32_t)((int32_t)in[i] - ADC_MID);
+    i1 += i0;
+    i2 += i1;
+    if (++count < d->cic_r) continue;
+    count = 0;
+
+    uint32_t c0 = i2 - d->comb[0];
+    d->comb[0] = i2;
+    uint32_t c1 = c0 - d->comb[1];
+    d->comb[1] = c0;
+    uint32_t c2 = c1 - d->comb[2];
+    d->comb[2] = c1;
+
+    if (fir_push(d, (int16_t)((int32_t)c2 >> d->shift), &out[written]))
+      written++;
+  }
+
+  d->integ[0] = i0;
+  d->integ[1] = i1;
+  d->integ[2] = i2;
+  d->cic_count = count;
+  return written;
+}
@@ -0,0 +1,48 @@
+// Streaming decimator for oversampled ADC data.
+//
+// A third-order CIC filter brings the raw 12-bit samples down by cic_r,
+// then a polyphase FIR low-pass brings them down by fir_r more, flattening
+// the CIC's passband droop on the way. Everything on the sample path is
+// integer arithmetic, and the state carries over from one call to the
+// next so DMA blocks can be fed in as they complete.
+//
+// Output samples are centred on zero and scaled by 2^DECIM_FRAC_BITS ADC
+// codes, so the resolution gained by averaging isn't rounded away.
+
+#pragma once
+#include <stdint.h>
+
+#define DECIM_CIC_ORDER 3
+#define DECIM_FRAC_BITS 3
+#define DECIM_MAX_PHASES 8         // largest fir_r
+#define DECIM_MAX_TAPS_PER_PHASE 32
+
+typedef struct {
+  uint32_t cic_r;
+  uint32_t fir_r;
+  uint32_t taps;                   // taps per phase
+  int shift;                       // CIC output scaling
+
+  // CIC integrators and comb delays; they wrap, which the combs undo
+  uint32_t integ[DECIM_CIC_ORDER];
+  uint32_t comb[DECIM_CIC_ORDER];
+  uint32_t cic_count;
+
+  // coef[p][j] is tap p + j*fir_r of the prototype filter, in Q15
+  int16_t coef[DECIM_MAX_PHASES][DECIM_MAX_TAPS_PER_PHASE];
+  // per-phase delay lines, stored twice so a dot product never wraps
+  int16_t hist[DECIM_MAX_PHASES][2*DECIM_MAX_TAPS_PER_PHASE];
+  uint32_t pos;
+  uint32_t phase;
+} decimator_t;
+
+// Designs the compensating filter and clears the state. Returns false if
+// the ratios or tap count are out of range. Uses floating point, so call
+// it once at startup rather than per block.
+bool decimator_init(decimator_t *d, uint32_t cic_r, uint32_t fir_r,
+		    uint32_t taps_per_phase);
+
+// Decimates n raw ADC samples into out, which must have room for
+// n/(cic_r*fir_r) + 1 samples. Returns the number written.
+uint32_t decimator_process(decimator_t *d, const uint16_t *in, uint32_t n,
+			   int16_t *out);
@@ -4,22 +4,106 @@
 #include <hardware/uart.h>
 #include <hardware/adc.h>
 #include <hardware/dma.h>
+#include <hardware/irq.h>
 #include <pico/stdio_usb.h>
 #include <pico/stdlib.h>
 #include <stdio.h>
 
+#include "block_desc.h"
+#include "memory_report.h"
+#if OVERSAMPLE
+#include "decimator.h"
+#endif
+
 #define NSAMP 5000
 // set this to determine sample rate
 // 0     = 500,000 Hz
 // 960   = 50,000 Hz
 // 9600  = 5,000 Hz
+#if OVERSAMPLE
+// The ADC runs flat out and the decimator brings it down to the 5 kHz
+// the model expects; averaging 100 samples into each one buys a few
+// bits over sampling at 5 kHz directly
+#define CLOCK_DIV 0
+#define OS_BLOCK 1000 // raw samples per DMA block, 2 ms
+#define OS_CIC_R 25
+#define OS_FIR_R 4
+#define OS_TAPS 32    // FIR taps per phase
+#else
 #define CLOCK_DIV 9600
+#endif
 
 #define CAPTURE_CHANNEL 0
 #define LED_PIN 25
 
+// One-pole DC blocker, y[n] = x[n] - x[n-1] + (1 - 2^-DC_SHIFT) y[n-1],
+// in fixed point with DC_FRAC_BITS fractional bits. Its corner is under
+// 1 Hz at 5 kHz, and it keeps its state from one block to the next so
+// the level it removes doesn't jump between blocks.
+#define DC_SHIFT 10
+#define DC_FRAC_BITS 12
+
+struct dc_blocker {
+  int32_t x1;  // previous input
+  int32_t acc; // previous output, DC_FRAC_BITS fractional bits
+  bool primed;
+};
+
+static inline int32_t dc_block(dc_blocker *b, int32_t x) {
+  b->acc += (x - b->x1) * (1 << DC_FRAC_BITS) - (b->acc >> DC_SHIFT);
+  b->x1 = x;
+  return b->acc;
+}
+
 float features[NSAMP];
+dc_blocker dc = {0, 0, false};
+
+#if OVERSAMPLE
+// Two DMA channels ping-pong between raw blocks, and the completion
+// interrupt decimates each one onto the end of a capture buffer. When a
+// capture buffer is full it is handed to the main loop and the other
+// one is filled.
+uint16_t raw_buf[2][OS_BLOCK];
+int16_t capture_buf[2][NSAMP];
+uint dma_chans[2];
+decimator_t decim;
+uint capture_fill;             // capture buffer being filled...
+uint capture_count;            // ...and how much of it is
+volatile int capture_ready = -1; // capture buffer waiting for the model
+
+static void decimate_block(const uint16_t *raw) {
+  int16_t out[OS_BLOCK / (OS_CIC_R * OS_FIR_R) + 1];
+  uint n = decimator_process(&decim, raw, OS_BLOCK, out);
+
+  for (uint i = 0; i < n; i++) {
+    capture_buf[capture_fill][capture_count++] = out[i];
+    if (capture_count < NSAMP) continue;
+
+    block_completed(NSAMP);
+    capture_ready = capture_fill;
+    capture_fill ^= 1;
+    capture_count = 0;
+  }
+}
+
+void dma_handler() {
+  for (int k = 0; k < 2; k++) {
+    if (!(dma_hw->ints0 & (1u << dma_chans[k]))) continue;
+    dma_channel_acknowledge_irq0(dma_chans[k]);
+    // re-arm for when the other channel chains back to this one
+    dma_channel_set_write_addr(dma_chans[k], raw_buf[k], false);
+    decimate_block(raw_buf[k]);
+  }
+}
+#else
 uint16_t capture_buf[NSAMP];
+uint dma_chan;
+
+void dma_handler() {
+  dma_channel_acknowledge_irq0(dma_chan);
+  block_completed(NSAMP);
+}
+#endif
 
 int raw_feature_get_data(size_t offset, size_t length, float *out_ptr)
 {
@@ -27,8 +111,53 @@ int raw_feature_get_data(size_t offset, size_t length, float *out_ptr)
   return 0;
 }
 
+// Runs the model on the features and prints what it heard. Returns
+// false if the classifier failed.
+static bool classify(signal_t *signal, ei_impulse_result_t *result,
+		     const block_desc &block)
+{
+  // invoke the impulse
+  EI_IMPULSE_ERROR res = run_classifier(signal, result, false);
+
+  if (res != 0) {
+    printf("run_classifier returned: %d\n", res);
+    return false;
+  }
+
+  // uncomment this for timing information
+  /*
+  printf("DSP: %d ms., Class.: %d ms., Anomaly: %d ms \n",
+	 result->timing.dsp, result->timing.classification,
+	 result->timing.anomaly);
+  */
+
+  if (EI_CLASSIFIER_HAS_ANOMALY == 1) printf("Anomaly!\n");
+
+
+  const float thresh = 0.9;
+  for (size_t ix = 0; ix < EI_CLASSIFIER_LABEL_COUNT; ix++) {
+    //printf("%.5f", result->classification[ix].value);
+    //if (ix != EI_CLASSIFIER_LABEL_COUNT - 1) printf(", ");
+
+      
+    if (ix == 0 && result->classification[ix].value > thresh)
+      printf("GO (sample %llu, %llu us)\n",
+	     (unsigned long long)block.first_sample,
+	     (unsigned long long)(time_us_64() - block.timestamp_us));
+    if (ix == 2 && result->classification[ix].value > thresh)
+      printf("STOP (sample %llu, %llu us)\n",
+	     (unsigned long long)block.first_sample,
+	     (unsigned long long)(time_us_64() - block.timestamp_us));
+      
+  }
+
+  //printf("\n");
+  return true;
+}
+
 int main()
 {
+  memory_paint_stack0();
   stdio_usb_init();
   stdio_init_all();
 
@@ -64,8 +193,74 @@ int main()
   adc_set_clkdiv(CLOCK_DIV);
 
   sleep_ms(1000);
+
+  const mem_buffer_t buffers[] = {
+    MEM_BUFFER(features, 0),
+#if OVERSAMPLE
+    MEM_BUFFER(raw_buf, 0),
+    MEM_BUFFER(decim, 0),
+#endif
+    MEM_BUFFER(capture_buf, 0),
+  };
+  memory_report_layout(buffers, sizeof(buffers) / sizeof(buffers[0]));
+
+  // descriptor of the block the model is looking at. Detections print
+  // its first sample and how long ago it was captured
+  block_desc block = {0, 0, 0};
+
+#if OVERSAMPLE
+  if (!decimator_init(&decim, OS_CIC_R, OS_FIR_R, OS_TAPS)) {
+    while (1) {
+      printf("Decimator settings out of range!\n");
+      sleep_ms(2000);
+    }
+  }
+
+  // Each channel fills its raw block and chains to the other, so the
+  // ADC never waits on the CPU
+  for (int k = 0; k < 2; k++) dma_chans[k] = dma_claim_unused_channel(true);
+  for (int k = 0; k < 2; k++) {
+    dma_channel_config cfg = dma_channel_get_default_config(dma_chans[k]);
+    channel_config_set_transfer_data_size(&cfg, DMA_SIZE_16);
+    channel_config_set_read_increment(&cfg, false);
+    channel_config_set_write_increment(&cfg, true);
+    channel_config_set_dreq(&cfg, DREQ_ADC);
+    channel_config_set_chain_to(&cfg, dma_chans[!k]);
+    dma_channel_configure(dma_chans[k], &cfg, raw_buf[k], &adc_hw->fifo,
+			  OS_BLOCK, k == 0);
+    dma_channel_set_irq0_enabled(dma_chans[k], true);
+  }
+
+  irq_set_exclusive_handler(DMA_IRQ_0, dma_handler);
+  irq_set_enabled(DMA_IRQ_0, true);
+  adc_fifo_drain();
+  adc_run(true);
+
+  while (true) {
+    // Capture runs on regardless; if the model takes longer than a
+    // buffer, it skips to the newest one
+    while (capture_ready < 0) tight_loop_contents();
+    int k = capture_ready;
+    capture_ready = -1;
+    block = block_latest();
+
+    // The decimated samples have DECIM_FRAC_BITS fractional bits; the
+    // model wants ADC codes around zero, as below
+    if (!dc.primed) {dc.x1 = capture_buf[k][0]; dc.primed = true;}
+    const float scale = 1.0f / (1 << (DC_FRAC_BITS + DECIM_FRAC_BITS));
+
+    for (uint32_t i=0; i<NSAMP; i++) {
+      features[i] = dc_block(&dc, capture_buf[k][i]) * scale;
+    }
+
+    gpio_put(LED_PIN, 1);
+    if (!classify(&features_signal, &result, block)) return 1;
+    memory_report_usage(false);
+    gpio_put(LED_PIN, 0);
+  }
+#else
   // Set up the DMA to start xfer data as soon as it appears in FIFO
-  uint dma_chan = dma_claim_unused_channel(true);
+  dma_chan = dma_claim_unused_channel(true);
   dma_channel_config cfg = dma_channel_get_default_config(dma_chan);
 
   // Reading from constant address, writing to incrementing byte address
@@ -76,6 +271,10 @@ int main()
   // Pace transfers based on availability of ADC samples
   channel_config_set_dreq(&cfg, DREQ_ADC);
 
+  dma_channel_set_irq0_enabled(dma_chan, true);
+  irq_set_exclusive_handler(DMA_IRQ_0, dma_handler);
+  irq_set_enabled(DMA_IRQ_0, true);
+
   while (true) {
     adc_fifo_drain();
     adc_run(false);
@@ -90,54 +289,22 @@ int main()
     gpio_put(LED_PIN, 1);
     adc_run(true);
     
-    // invoke the impulse
-    EI_IMPULSE_ERROR res = run_classifier(&features_signal, &result,
-					  false);
-
-    if (res != 0) {
-      printf("run_classifier returned: %d\n", res);
-      return 1;
-    }
-
-    // uncomment this for timing information
-    /*
-    printf("DSP: %d ms., Class.: %d ms., Anomaly: %d ms \n",
-	   result.timing.dsp, result.timing.classification,
-	   result.timing.anomaly);
-    */
-
-    if (EI_CLASSIFIER_HAS_ANOMALY == 1) printf("Anomaly!\n");
-
-
-    const float thresh = 0.9;
-    for (size_t ix = 0; ix < EI_CLASSIFIER_LABEL_COUNT; ix++) {
-      //printf("%.5f", result.classification[ix].value);
-      //if (ix != EI_CLASSIFIER_LABEL_COUNT - 1) printf(", ");
-
-      
-      if (ix == 0 && result.classification[ix].value > thresh)
-	printf("GO\n");
-      if (ix == 2 && result.classification[ix].value > thresh)
-	printf("STOP\n");
-      
-    }
-
-    //printf("\n");
+    if (!classify(&features_signal, &result, block)) return 1;
+    memory_report_usage(false);
 
     gpio_put(LED_PIN, 0);
     dma_channel_wait_for_finish_blocking(dma_chan);
+    block = block_latest();
 
     // Copy everything to feature buffer to run model. In my training,
     // I fed the model float values from WAVs so we need to bring the
     // sample level to zero and convert to floats
-    uint64_t sum = 0;
-    for (uint32_t i=0; i<NSAMP; i++) {
-      sum += capture_buf[i];
-    }
-    float dc_offset = (float)sum/NSAMP;
-    
+    if (!dc.primed) {dc.x1 = capture_buf[0]; dc.primed = true;}
+    const float scale = 1.0f / (1 << DC_FRAC_BITS);
+
     for (uint32_t i=0; i<NSAMP; i++) {
-      features[i] = (float)capture_buf[i]-dc_offset;
+      features[i] = dc_block(&dc, capture_buf[i]) * scale;
     }
   }
+#endif
 }
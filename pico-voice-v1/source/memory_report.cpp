@@ -0,0 +1,116 @@
+#include "memory_report.h"
+
+#include <stdio.h>
+#include "ei_run_classifier.h"
+
+#if PICO_ON_DEVICE
+#include <malloc.h>
+#include <pico/platform.h>
+
+#define STACK_PAINT 0xdeadbeef
+// room left below core 0's stack pointer when painting, for the painting
+#define PAINT_MARGIN 64
+
+// from the SDK's linker script
+extern char __data_start__, __data_end__, __bss_start__, __bss_end__;
+extern char __end__, __HeapLimit;
+extern char __StackBottom, __StackTop, __StackOneBottom, __StackOneTop;
+
+static const char *stack_bottom[2] = { &__StackBottom, &__StackOneBottom };
+static const char *stack_top[2] = { &__StackTop, &__StackOneTop };
+
+static bool painted[2];
+static size_t heap_reported;
+static size_t stack_reported[2];
+
+static void paint(char *from, char *to) {
+  for (uint32_t *p = (uint32_t *)from; p < (uint32_t *)to; p++)
+    *p = STACK_PAINT;
+}
+
+void memory_paint_stack0() {
+  char here;
+  paint(&__StackBottom, &here - PAINT_MARGIN);
+  painted[0] = true;
+}
+
+void memory_paint_stack1() {
+  paint(&__StackOneBottom, &__StackOneTop);
+  painted[1] = true;
+}
+
+// deepest the stack has been: everything above the lowest overwritten word
+static size_t stack_used(int core) {
+  const uint32_t *p = (const uint32_t *)stack_bottom[core];
+  while (p < (const uint32_t *)stack_top[core] && *p == STACK_PAINT) p++;
+  return stack_top[core] - (const char *)p;
+}
+#else
+void memory_paint_stack0() {}
+void memory_paint_stack1() {}
+#endif
+
+// the SDK names the arena size differently across versions
+#if defined(EI_CLASSIFIER_TFLITE_LARGEST_ARENA_SIZE)
+#define ARENA_BYTES EI_CLASSIFIER_TFLITE_LARGEST_ARENA_SIZE
+#elif defined(EI_CLASSIFIER_TFLITE_ARENA_SIZE)
+#define ARENA_BYTES EI_CLASSIFIER_TFLITE_ARENA_SIZE
+#else
+#define ARENA_BYTES 0
+#endif
+
+void memory_report_layout(const mem_buffer_t *buffers, int n) {
+#if PICO_ON_DEVICE
+  printf("RAM: data %u, bss %u, heap space %u\n",
+	 (unsigned)(&__data_end__ - &__data_start__),
+	 (unsigned)(&__bss_end__ - &__bss_start__),
+	 (unsigned)(&__HeapLimit - &__end__));
+#endif
+
+#if EI_CLASSIFIER_ALLOCATION_STATIC
+  printf("Tensor arena: %u, static\n", (unsigned)ARENA_BYTES);
+#else
+  printf("Tensor arena: %u, heap\n", (unsigned)ARENA_BYTES);
+#endif
+
+  for (int core = 0; core < 2; core++) {
+    size_t total = 0;
+    for (int i = 0; i < n; i++)
+      if (buffers[i].core == core) total += buffers[i].bytes;
+    if (!total) continue;
+
+    printf("Core %d buffers: %u (", core, (unsigned)total);
+    bool first = true;
+    for (int i = 0; i < n; i++) {
+      if (buffers[i].core != core) continue;
+      printf("%s%s %u", first ? "" : ", ", buffers[i].name,
+	     (unsigned)buffers[i].bytes);
+      first = false;
+    }
+    printf(")\n");
+  }
+}
+
+void memory_report_usage(bool force) {
+#if PICO_ON_DEVICE
+  // newlib's heap only grows, so its size is the high-water mark
+  struct mallinfo m = mallinfo();
+  size_t heap_peak = m.arena;
+  size_t stack[2] = { stack_used(0), stack_used(1) };
+
+  if (!force && heap_peak <= heap_reported &&
+      stack[0] <= stack_reported[0] && stack[1] <= stack_reported[1])
+    return;
+  heap_reported = heap_peak;
+  stack_reported[0] = stack[0];
+  stack_reported[1] = stack[1];
+
+  printf("Heap: %u in use, peak %u of %u\n", (unsigned)m.uordblks,
+	 (unsigned)heap_peak, (unsigned)(&__HeapLimit - &__end__));
+  for (int core = 0; core < 2; core++) {
+    if (!painted[core]) continue;
+    printf("Core %d stack: peak %u of %u\n", core, (unsigned)stack[core],
+	   (unsigned)(stack_top[core] - stack_bottom[core]));
+  }
+#endif
+}
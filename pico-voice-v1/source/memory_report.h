@@ -0,0 +1,33 @@
+// RAM use of the voice programs, printed at boot and as it grows.
+//
+// Globals (.data and .bss, which include the tensor arena when it is
+// statically allocated) are fixed at link time. The heap is measured by
+// its high-water mark. Each core's stack is painted with a pattern
+// before use, and its depth is measured by how much of the pattern has
+// been overwritten.
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// A global buffer worth listing on its own, and the core that uses it
+typedef struct {
+  const char *name;
+  size_t bytes;
+  int core;
+} mem_buffer_t;
+
+#define MEM_BUFFER(buf, core) { #buf, sizeof(buf), core }
+
+// Paints the unused part of core 0's stack. Call it first thing in main().
+void memory_paint_stack0();
+
+// Paints all of core 1's stack. Call it before multicore_launch_core1().
+void memory_paint_stack1();
+
+// Prints the link-time layout, the arena and the named buffers
+void memory_report_layout(const mem_buffer_t *buffers, int n);
+
+// Prints heap and stack high-water marks if either has grown since the
+// last call, or always if force is set. Call it after inferences.
+void memory_report_usage(bool force);